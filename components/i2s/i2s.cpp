@@ -6,6 +6,11 @@ namespace i2s {
 
 static const char *const TAG = "i2s";
 
+// driver posts an event for every received DMA buffer and drops the oldest one when the queue is full,
+// so overflow events are counted exactly as long as all events between two reads fit into the queue
+// (8 bytes each), i.e. longer stalls are undercounted
+static const int EVENT_QUEUE_SIZE = 64;
+
 void I2SComponent::set_ws_pin(InternalGPIOPin *ws_pin) { this->ws_pin_ = ws_pin; }
 void I2SComponent::set_bck_pin(InternalGPIOPin *bck_pin) { this->bck_pin_ = bck_pin; }
 void I2SComponent::set_din_pin(InternalGPIOPin *din_pin) { this->din_pin_ = din_pin; }
@@ -24,6 +29,9 @@ void I2SComponent::set_use_apll(bool use_apll) { this->use_apll_ = use_apll; }
 bool I2SComponent::get_use_apll() const { return this->use_apll_; }
 void I2SComponent::set_bits_shift(uint8_t bits_shift) { this->bits_shift_ = bits_shift; }
 uint8_t I2SComponent::get_bits_shift() const { return this->bits_shift_; }
+uint32_t I2SComponent::get_overflow_count() const { return this->overflow_count_; }
+uint32_t I2SComponent::get_dropped_samples() const { return this->overflow_count_ * this->dma_buf_len_; }
+uint32_t I2SComponent::get_short_reads() const { return this->short_reads_; }
 float I2SComponent::get_setup_priority() const { return setup_priority::BUS; }
 void I2SComponent::set_channel(i2s_channel_fmt_t channel) { this->channel_ = channel; }
 
@@ -44,19 +52,37 @@ void I2SComponent::dump_config() {
                 this->channel_ == I2S_CHANNEL_FMT_ONLY_RIGHT  ? "right"
                 : this->channel_ == I2S_CHANNEL_FMT_ONLY_LEFT ? "left"
                                                               : "invalid");
+  // config is dumped again when a log client connects, so counters show what happened since setup.
+  // Short reads don't lose samples, the rest stays in DMA buffers for the next read
+  ESP_LOGCONFIG(TAG, "  DMA Overflows: %lu (%lu samples dropped)", this->get_overflow_count(),
+                this->get_dropped_samples());
+  ESP_LOGCONFIG(TAG, "  Short Reads: %lu", this->get_short_reads());
 }
 
 bool I2SComponent::read(uint8_t *data, size_t len, size_t *bytes_read, TickType_t ticks_to_wait) {
   esp_err_t err = i2s_read(i2s_port_t(this->port_num_), data, len, bytes_read, ticks_to_wait);
+  this->process_events_();
 
   if (err != ESP_OK) {
     ESP_LOGW(TAG, "i2s_read failed: %s", esp_err_to_name(err));
     return false;
   }
+  if (*bytes_read < len)
+    this->short_reads_.fetch_add(1, std::memory_order_relaxed);
 
   return true;
 }
 
+void I2SComponent::process_events_() {
+  if (this->event_queue_ == nullptr)
+    return;
+  i2s_event_t event;
+  while (xQueueReceive(this->event_queue_, &event, 0) == pdTRUE) {
+    if (event.type == I2S_EVENT_RX_Q_OVF)
+      this->overflow_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 bool I2SComponent::read_samples(int32_t *data, size_t num_samples, size_t *samples_read, TickType_t ticks_to_wait) {
   if (this->bits_per_sample_ <= 16) {
     ESP_LOGE(TAG,
@@ -157,7 +183,7 @@ void I2SComponent::setup() {
       .data_out_num = this->dout_pin_ != nullptr ? this->dout_pin_->get_pin() : I2S_PIN_NO_CHANGE,
       .data_in_num = this->din_pin_ != nullptr ? this->din_pin_->get_pin() : I2S_PIN_NO_CHANGE};
 
-  esp_err_t err = i2s_driver_install(i2s_port_t(this->port_num_), &i2s_config, 0, NULL);
+  esp_err_t err = i2s_driver_install(i2s_port_t(this->port_num_), &i2s_config, EVENT_QUEUE_SIZE, &this->event_queue_);
   if (err != ESP_OK) {
     ESP_LOGW(TAG, "i2s_driver_install failed: %s", esp_err_to_name(err));
     this->mark_failed();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <driver/i2s.h>
 #include "esphome/core/defines.h"
@@ -30,6 +31,12 @@ class I2SComponent : public Component {
   bool get_use_apll() const;
   void set_bits_shift(uint8_t bits_shift);
   uint8_t get_bits_shift() const;
+  // number of DMA buffers overwritten by the driver before they were read, since setup
+  uint32_t get_overflow_count() const;
+  // samples lost due to DMA overflows, since setup
+  uint32_t get_dropped_samples() const;
+  // reads that returned less data than requested because of timeout, since setup
+  uint32_t get_short_reads() const;
   bool read(uint8_t *data, size_t len, size_t *bytes_read, TickType_t ticks_to_wait = portMAX_DELAY);
   bool read_samples(int32_t *data, size_t num_samples, size_t *samples_read, TickType_t ticks_to_wait = portMAX_DELAY);
   bool read_samples(int16_t *data, size_t num_samples, size_t *samples_read, TickType_t ticks_to_wait = portMAX_DELAY);
@@ -55,6 +62,12 @@ class I2SComponent : public Component {
   bool use_apll_{false};
   uint8_t bits_shift_{0};
   i2s_channel_fmt_t channel_{I2S_CHANNEL_FMT_ONLY_RIGHT};
+  QueueHandle_t event_queue_{nullptr};
+  // counters are updated by the reading task and read from the main loop
+  std::atomic<uint32_t> overflow_count_{0};
+  std::atomic<uint32_t> short_reads_{0};
+
+  void process_events_();
 };
 }  // namespace i2s
 }  // namespace esphome
@@ -1,21 +1,50 @@
 # pylint: disable=no-name-in-module,invalid-name,unused-argument
 
+import copy
+import logging
+
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
 from esphome import automation
 from esphome.automation import maybe_simple_id
-from esphome.components import sensor, i2s
+from esphome.components import esp32, sensor, i2s
+from esphome.components import time as time_
 from esphome.const import (
     CONF_ID,
+    CONF_INTERNAL,
+    CONF_NAME,
     CONF_SENSORS,
     CONF_FILTERS,
     CONF_WINDOW_SIZE,
     CONF_UPDATE_INTERVAL,
     CONF_TYPE,
+    CONF_TRIGGER_ID,
+    CONF_PORT,
+    CONF_SIZE,
+    CONF_TIME_ID,
+    CONF_UNIT_OF_MEASUREMENT,
     UNIT_DECIBEL,
+    UNIT_MILLISECOND,
+    UNIT_PERCENT,
     STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+)
+from esphome.core import CORE, ID
+from .filter_design import (
+    butter_bandpass,
+    butter_lowpass,
+    decimation_stages,
+    format_frequency,
+    fractional_octave_bands,
+    iec_61672_class,
+    weighting_filter,
+    WEIGHTINGS,
 )
 
+_LOGGER = logging.getLogger(__name__)
+
 CODEOWNERS = ["@stas-sl"]
 DEPENDENCIES = ["esp32", "i2s"]
 AUTO_LOAD = ["sensor"]
@@ -38,12 +67,62 @@ SoundLevelMeterSensorMin = sound_level_meter_ns.class_(
 SoundLevelMeterSensorPeak = sound_level_meter_ns.class_(
     "SoundLevelMeterSensorPeak", SoundLevelMeterSensor, sensor.Sensor
 )
+SoundLevelMeterSensorTimeWeighted = sound_level_meter_ns.class_(
+    "SoundLevelMeterSensorTimeWeighted", SoundLevelMeterSensor, sensor.Sensor
+)
+SoundLevelMeterSensorPercentile = sound_level_meter_ns.class_(
+    "SoundLevelMeterSensorPercentile", SoundLevelMeterSensor, sensor.Sensor
+)
+SoundLevelMeterSensorExposure = sound_level_meter_ns.class_(
+    "SoundLevelMeterSensorExposure", SoundLevelMeterSensor, sensor.Sensor, cg.Component
+)
+TimeWeighting = sound_level_meter_ns.enum("TimeWeighting")
+ExposureMetric = sound_level_meter_ns.enum("ExposureMetric")
+TimeWeightedStatistic = sound_level_meter_ns.enum("TimeWeightedStatistic")
 SensorGroup = sound_level_meter_ns.class_("SensorGroup")
 Filter = sound_level_meter_ns.class_("Filter")
 SOS_Filter = sound_level_meter_ns.class_("SOS_Filter", Filter)
+FusedSOS_Filter = sound_level_meter_ns.class_("FusedSOS_Filter", Filter)
+DecimationFilter = sound_level_meter_ns.class_("DecimationFilter", Filter)
+SwitchableSOS_Filter = sound_level_meter_ns.class_("SwitchableSOS_Filter", Filter)
+SOSCoeffs = SwitchableSOS_Filter.class_("SOSCoeffs")
+SetCoeffsAction = sound_level_meter_ns.class_("SetCoeffsAction", automation.Action)
+FilterBank = sound_level_meter_ns.class_("FilterBank")
+PcmTap = sound_level_meter_ns.class_("PcmTap")
 ToggleAction = sound_level_meter_ns.class_("ToggleAction", automation.Action)
 TurnOffAction = sound_level_meter_ns.class_("TurnOffAction", automation.Action)
 TurnOnAction = sound_level_meter_ns.class_("TurnOnAction", automation.Action)
+GroupToggleAction = sound_level_meter_ns.class_("GroupToggleAction", automation.Action)
+GroupTurnOffAction = sound_level_meter_ns.class_(
+    "GroupTurnOffAction", automation.Action
+)
+GroupTurnOnAction = sound_level_meter_ns.class_("GroupTurnOnAction", automation.Action)
+DumpProfileAction = sound_level_meter_ns.class_(
+    "DumpProfileAction", automation.Action
+)
+ThresholdTrigger = sound_level_meter_ns.class_(
+    "ThresholdTrigger", automation.Trigger.template(cg.float_)
+)
+SnapshotTrigger = sound_level_meter_ns.class_(
+    "SnapshotTrigger", automation.Trigger.template()
+)
+TakeSnapshotAction = sound_level_meter_ns.class_(
+    "TakeSnapshotAction", automation.Action
+)
+ReleaseSnapshotAction = sound_level_meter_ns.class_(
+    "ReleaseSnapshotAction", automation.Action
+)
+HistoryRecord = sound_level_meter_ns.struct("HistoryRecord")
+HistoryExportTrigger = sound_level_meter_ns.class_(
+    "HistoryExportTrigger",
+    automation.Trigger.template(cg.std_vector.template(HistoryRecord)),
+)
+ExportHistoryAction = sound_level_meter_ns.class_(
+    "ExportHistoryAction", automation.Action
+)
+SampleLossTrigger = sound_level_meter_ns.class_(
+    "SampleLossTrigger", automation.Trigger.template(cg.float_)
+)
 
 
 CONF_I2S_ID = "i2s_id"
@@ -52,9 +131,22 @@ CONF_EQ = "eq"
 CONF_MAX = "max"
 CONF_MIN = "min"
 CONF_PEAK = "peak"
+CONF_TIME_WEIGHTED = "time_weighted"
+CONF_TIME_WEIGHTING = "time_weighting"
+CONF_STATISTIC = "statistic"
+CONF_PERCENTILE = "percentile"
+CONF_SLIDING_WINDOW = "sliding_window"
 CONF_BUFFER_SIZE = "buffer_size"
 CONF_SOS = "sos"
 CONF_COEFFS = "coeffs"
+CONF_DECIMATION = "decimation"
+CONF_FACTOR = "factor"
+CONF_WEIGHTING = "weighting"
+CONF_SWITCHABLE = "switchable"
+CONF_SETS = "sets"
+CONF_SET = "set"
+CONF_RESET_STATE = "reset_state"
+CONF_SETTLE_TIME = "settle_time"
 CONF_WARMUP_INTERVAL = "warmup_interval"
 CONF_TASK_STACK_SIZE = "task_stack_size"
 CONF_TASK_PRIORITY = "task_priority"
@@ -63,10 +155,124 @@ CONF_MIC_SENSITIVITY = "mic_sensitivity"
 CONF_MIC_SENSITIVITY_REF = "mic_sensitivity_ref"
 CONF_OFFSET = "offset"
 CONF_IS_ON = "is_on"
+CONF_USE_PSRAM = "use_psram"
+CONF_PUBLISH_QUEUE_SIZE = "publish_queue_size"
+CONF_FIXED_POINT = "fixed_point"
+CONF_USE_ESP_DSP = "use_esp_dsp"
+CONF_BUFFER_COUNT = "buffer_count"
+CONF_READER_TASK_PRIORITY = "reader_task_priority"
+CONF_READER_TASK_CORE = "reader_task_core"
+CONF_WORKER_COUNT = "worker_count"
+CONF_FILTER_BANK = "filter_bank"
+CONF_BANDS = "bands"
+CONF_MIN_FREQUENCY = "min_frequency"
+CONF_MAX_FREQUENCY = "max_frequency"
+CONF_BAND_SENSORS = "band_sensors"
+CONF_PROFILING = "profiling"
+CONF_CPU_LOAD = "cpu_load"
+CONF_I2S_READ_WAIT = "i2s_read_wait"
+CONF_PUBLISH_LATENCY = "publish_latency"
+CONF_DROPPED_SAMPLES = "dropped_samples"
+CONF_SAMPLE_LOSS_THRESHOLD = "sample_loss_threshold"
+CONF_ON_SAMPLE_LOSS = "on_sample_loss"
+CONF_THRESHOLD = "threshold"
+CONF_ABOVE = "above"
+CONF_FOR = "for"
+CONF_HYSTERESIS = "hysteresis"
+CONF_PUBLISH = "publish"
+CONF_ON_THRESHOLD = "on_threshold"
+CONF_THRESHOLD_LATENCY = "threshold_latency"
+CONF_SNAPSHOT = "snapshot"
+CONF_DURATION = "duration"
+CONF_POST_TRIGGER = "post_trigger"
+CONF_ON_SNAPSHOT = "on_snapshot"
+CONF_TAP = "tap"
+CONF_HISTORY = "history"
+CONF_BATCH_SIZE = "batch_size"
+CONF_ON_HISTORY_EXPORT = "on_history_export"
+CONF_EXPOSURE = "exposure"
+CONF_METRIC = "metric"
+CONF_CRITERION_LEVEL = "criterion_level"
+CONF_CHECKPOINT_INTERVAL = "checkpoint_interval"
+CONF_DAY_START_HOUR = "day_start_hour"
 
 ICON_WAVEFORM = "mdi:waveform"
 
-CONFIG_SENSOR_SCHEMA = cv.typed_schema(
+TIME_WEIGHTINGS = {
+    "fast": TimeWeighting.TIME_WEIGHTING_FAST,
+    "slow": TimeWeighting.TIME_WEIGHTING_SLOW,
+    "impulse": TimeWeighting.TIME_WEIGHTING_IMPULSE,
+}
+TIME_WEIGHTED_STATISTICS = {
+    "max": TimeWeightedStatistic.TIME_WEIGHTED_MAX,
+    "min": TimeWeightedStatistic.TIME_WEIGHTED_MIN,
+    "instantaneous": TimeWeightedStatistic.TIME_WEIGHTED_INSTANTANEOUS,
+}
+EXPOSURE_METRICS = {
+    "lex_8h": ExposureMetric.EXPOSURE_LEX_8H,
+    "lden": ExposureMetric.EXPOSURE_LDEN,
+    "dose": ExposureMetric.EXPOSURE_DOSE,
+}
+
+# SOS cascades up to this length get a kernel specialized for their number of sections,
+# longer ones fall back to the generic SOS_Filter to keep code size in check
+MAX_FUSED_SOS_SECTIONS = 8
+
+# fixed point SOS coefficients have 29 fractional bits, so they must fit into (-4, 4)
+MAX_FIXED_POINT_COEFF = 4.0
+
+# filter bank bands are 3rd order Butterworth band pass filters (3 sections),
+# which meet IEC 61260-1 class 1 attenuation limits
+BANDS = {"octave": 1, "third_octave": 3}
+BAND_FILTER_ORDER = 3
+# each band is processed at the lowest sample rate that is at least this many times
+# higher than its upper edge, decimator low pass filter is designed with the same
+# margin: it passes up to 1/10 of its input rate and attenuates aliases by over 90dB
+BAND_DECIMATION_MARGIN = 5
+DECIMATOR_ORDER = 6
+DECIMATOR_CUTOFF = 0.15
+MAX_BAND_UPPER_EDGE = 0.45
+
+# checked by the audio task, see SoundLevelMeterSensor::set_threshold()
+CONFIG_THRESHOLD_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_ABOVE): cv.float_,
+        cv.Optional(CONF_FOR, default="0ms"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_HYSTERESIS, default=3): cv.positive_float,
+        cv.Optional(CONF_PUBLISH, default=True): cv.boolean,
+    }
+)
+
+SENSOR_THRESHOLD_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_THRESHOLD): CONFIG_THRESHOLD_SCHEMA,
+        cv.Optional(CONF_ON_THRESHOLD): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(ThresholdTrigger)}
+        ),
+    }
+)
+
+
+def validate_threshold(config):
+    if CONF_ON_THRESHOLD in config and CONF_THRESHOLD not in config:
+        raise cv.Invalid(f"{CONF_ON_THRESHOLD} requires {CONF_THRESHOLD}")
+    return config
+
+
+def validate_exposure(config):
+    # dose is in percent, unless the unit is set explicitly
+    if config[CONF_METRIC] == "dose" and config.get(CONF_UNIT_OF_MEASUREMENT) in (
+        None,
+        UNIT_DECIBEL,
+    ):
+        config[CONF_UNIT_OF_MEASUREMENT] = UNIT_PERCENT
+    # Lden cycle starts with the day period, so that the night is not split at midnight
+    if CONF_DAY_START_HOUR not in config:
+        config[CONF_DAY_START_HOUR] = 7 if config[CONF_METRIC] == "lden" else 0
+    return config
+
+
+SENSOR_TYPES_SCHEMA = cv.typed_schema(
     {
         CONF_EQ: sensor.sensor_schema(
             SoundLevelMeterSensorEq,
@@ -75,7 +281,11 @@ CONFIG_SENSOR_SCHEMA = cv.typed_schema(
             state_class=STATE_CLASS_MEASUREMENT,
             icon=ICON_WAVEFORM,
         ).extend(
-            {cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds}
+            {
+                cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds,
+                cv.Optional(CONF_SLIDING_WINDOW): cv.positive_time_period_milliseconds,
+            },
+            SENSOR_THRESHOLD_SCHEMA,
         ),
         CONF_MAX: sensor.sensor_schema(
             SoundLevelMeterSensorMax,
@@ -87,7 +297,9 @@ CONFIG_SENSOR_SCHEMA = cv.typed_schema(
             {
                 cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds,
                 cv.Required(CONF_WINDOW_SIZE): cv.positive_time_period_milliseconds,
-            }
+                cv.Optional(CONF_SLIDING_WINDOW): cv.positive_time_period_milliseconds,
+            },
+            SENSOR_THRESHOLD_SCHEMA,
         ),
         CONF_MIN: sensor.sensor_schema(
             SoundLevelMeterSensorMin,
@@ -99,7 +311,9 @@ CONFIG_SENSOR_SCHEMA = cv.typed_schema(
             {
                 cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds,
                 cv.Required(CONF_WINDOW_SIZE): cv.positive_time_period_milliseconds,
-            }
+                cv.Optional(CONF_SLIDING_WINDOW): cv.positive_time_period_milliseconds,
+            },
+            SENSOR_THRESHOLD_SCHEMA,
         ),
         CONF_PEAK: sensor.sensor_schema(
             SoundLevelMeterSensorPeak,
@@ -108,33 +322,327 @@ CONFIG_SENSOR_SCHEMA = cv.typed_schema(
             state_class=STATE_CLASS_MEASUREMENT,
             icon=ICON_WAVEFORM,
         ).extend(
-            {cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds}
+            {cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds},
+            SENSOR_THRESHOLD_SCHEMA,
+        ),
+        CONF_TIME_WEIGHTED: sensor.sensor_schema(
+            SoundLevelMeterSensorTimeWeighted,
+            unit_of_measurement=UNIT_DECIBEL,
+            accuracy_decimals=2,
+            state_class=STATE_CLASS_MEASUREMENT,
+            icon=ICON_WAVEFORM,
+        ).extend(
+            {
+                cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds,
+                cv.Required(CONF_TIME_WEIGHTING): cv.enum(TIME_WEIGHTINGS, lower=True),
+                cv.Optional(CONF_STATISTIC, default="max"): cv.enum(
+                    TIME_WEIGHTED_STATISTICS, lower=True
+                ),
+            },
+            SENSOR_THRESHOLD_SCHEMA,
+        ),
+        CONF_PERCENTILE: sensor.sensor_schema(
+            SoundLevelMeterSensorPercentile,
+            unit_of_measurement=UNIT_DECIBEL,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            icon=ICON_WAVEFORM,
+        ).extend(
+            {
+                cv.Optional(CONF_UPDATE_INTERVAL): cv.positive_time_period_milliseconds,
+                cv.Optional(
+                    CONF_WINDOW_SIZE, default="125ms"
+                ): cv.positive_time_period_milliseconds,
+                cv.Required(CONF_PERCENTILE): cv.float_range(min=0, max=100),
+            },
+            SENSOR_THRESHOLD_SCHEMA,
+        ),
+        CONF_EXPOSURE: cv.All(
+            sensor.sensor_schema(
+                SoundLevelMeterSensorExposure,
+                unit_of_measurement=UNIT_DECIBEL,
+                accuracy_decimals=2,
+                state_class=STATE_CLASS_MEASUREMENT,
+                icon=ICON_WAVEFORM,
+            ).extend(
+                {
+                    cv.GenerateID(CONF_TIME_ID): cv.use_id(time_.RealTimeClock),
+                    cv.Required(CONF_METRIC): cv.one_of(*EXPOSURE_METRICS, lower=True),
+                    cv.Optional(
+                        CONF_UPDATE_INTERVAL
+                    ): cv.positive_time_period_milliseconds,
+                    cv.Optional(CONF_CRITERION_LEVEL, default=85): cv.decibel,
+                    cv.Optional(
+                        CONF_CHECKPOINT_INTERVAL, default="5min"
+                    ): cv.positive_time_period_milliseconds,
+                    cv.Optional(CONF_DAY_START_HOUR): cv.int_range(min=0, max=23),
+                }
+            ),
+            validate_exposure,
         ),
     }
 )
 
+CONFIG_SENSOR_SCHEMA = cv.All(SENSOR_TYPES_SCHEMA, validate_threshold)
+
+
+def validate_filter_set(config):
+    if (CONF_WEIGHTING in config) == (CONF_COEFFS in config):
+        raise cv.Invalid(
+            f"Exactly one of {CONF_WEIGHTING} or {CONF_COEFFS} is required"
+        )
+    if CONF_NAME not in config:
+        if CONF_WEIGHTING not in config:
+            raise cv.Invalid(f"{CONF_NAME} is required for {CONF_COEFFS}")
+        config[CONF_NAME] = config[CONF_WEIGHTING]
+    return config
+
+
+def validate_filter_sets(config):
+    names = [sc[CONF_NAME] for sc in config]
+    for name in names:
+        if names.count(name) > 1:
+            raise cv.Invalid(f"Set name '{name}' is used more than once")
+    return config
+
+
+SOS_COEFFS_SCHEMA = cv.All(
+    [cv.All([cv.float_], cv.Length(min=5, max=5))],
+    cv.Length(min=1),
+)
+
+CONFIG_FILTER_SET_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Optional(CONF_NAME): cv.string_strict,
+            cv.Optional(CONF_WEIGHTING): cv.one_of(*WEIGHTINGS, upper=True),
+            cv.Optional(CONF_COEFFS): SOS_COEFFS_SCHEMA,
+        }
+    ),
+    validate_filter_set,
+)
+
 CONFIG_FILTER_SCHEMA = cv.typed_schema(
     {
         CONF_SOS: cv.Schema(
             {
-                cv.GenerateID(): cv.declare_id(SOS_Filter),
-                cv.Required(CONF_COEFFS): [[cv.float_]],
+                cv.GenerateID(): cv.declare_id(FusedSOS_Filter),
+                cv.Required(CONF_COEFFS): SOS_COEFFS_SCHEMA,
             }
-        )
+        ),
+        CONF_DECIMATION: cv.Schema(
+            {
+                cv.GenerateID(): cv.declare_id(DecimationFilter),
+                cv.Required(CONF_FACTOR): cv.int_range(min=2, max=64),
+            }
+        ),
+        # coefficients are designed at compile time for the actual sample rate
+        CONF_WEIGHTING: cv.Schema(
+            {
+                cv.GenerateID(): cv.declare_id(FusedSOS_Filter),
+                cv.Required(CONF_WEIGHTING): cv.one_of(*WEIGHTINGS, upper=True),
+            }
+        ),
+        # coefficient sets switched at runtime by sound_level_meter.filter.set_coeffs,
+        # the first one is active at start
+        CONF_SWITCHABLE: cv.Schema(
+            {
+                cv.Required(CONF_ID): cv.declare_id(SwitchableSOS_Filter),
+                cv.Required(CONF_SETS): cv.All(
+                    [CONFIG_FILTER_SET_SCHEMA], cv.Length(min=1), validate_filter_sets
+                ),
+                cv.Optional(CONF_RESET_STATE, default=True): cv.boolean,
+                cv.Optional(CONF_SETTLE_TIME): cv.positive_time_period_milliseconds,
+            }
+        ),
     }
 )
 
 
+def filter_bank_bands(config):
+    return fractional_octave_bands(
+        BANDS[config[CONF_BANDS]],
+        config[CONF_MIN_FREQUENCY],
+        config[CONF_MAX_FREQUENCY],
+    )
+
+
+def copy_sensor_for_band(config, band):
+    """Copy of sensor config for a single band: {band} in name is replaced
+    with nominal band frequency, manually specified ids get band suffix"""
+    config = copy.deepcopy(config)
+    suffix = band.lower().replace(".", "_")
+
+    def suffix_ids(value):
+        if isinstance(value, ID):
+            if value.is_declaration and value.is_manual:
+                value.id = f"{value.id}_{suffix}"
+        elif isinstance(value, dict):
+            for v in value.values():
+                suffix_ids(v)
+        elif isinstance(value, list):
+            for v in value:
+                suffix_ids(v)
+
+    suffix_ids(config)
+    if isinstance(config.get(CONF_NAME), str):
+        name = config[CONF_NAME]
+        config[CONF_NAME] = (
+            name.replace("{band}", band) if "{band}" in name else f"{name} {band}"
+        )
+    return config
+
+
+def expand_filter_bank_sensors(config):
+    bands = filter_bank_bands(config)
+    if not bands:
+        raise cv.Invalid(
+            f"No {config[CONF_BANDS]} bands between {config[CONF_MIN_FREQUENCY]}Hz "
+            f"and {config[CONF_MAX_FREQUENCY]}Hz"
+        )
+    config[CONF_BAND_SENSORS] = [
+        [
+            copy_sensor_for_band(sc, format_frequency(nominal))
+            for sc in config[CONF_SENSORS]
+        ]
+        for nominal, _, _, _ in bands
+    ]
+    # templates themselves are never created
+    del config[CONF_SENSORS]
+    return config
+
+
+CONFIG_FILTER_BANK_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.declare_id(FilterBank),
+            cv.Required(CONF_BANDS): cv.one_of(*BANDS, lower=True),
+            cv.Optional(CONF_MIN_FREQUENCY, default="63Hz"): cv.frequency,
+            cv.Optional(CONF_MAX_FREQUENCY, default="8kHz"): cv.frequency,
+            # created for each band
+            cv.Required(CONF_SENSORS): [CONFIG_SENSOR_SCHEMA],
+        }
+    ),
+    expand_filter_bank_sensors,
+)
+
+
 def config_group_schema(value):
     return CONFIG_GROUP_SCHEMA(value)
 
 
+# every buffer is a block of buffer_size float samples, blocks are dropped
+# when the client can't keep up and all of them are waiting to be sent
+CONFIG_TAP_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(PcmTap),
+        cv.Required(CONF_PORT): cv.port,
+        cv.Optional(CONF_BUFFER_COUNT, default=8): cv.int_range(min=2, max=255),
+    }
+)
+
+
 CONFIG_GROUP_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.declare_id(SensorGroup),
+        cv.Optional(CONF_IS_ON, default=True): cv.boolean,
         cv.Optional(CONF_FILTERS): [CONFIG_FILTER_SCHEMA],
         cv.Optional(CONF_SENSORS): [CONFIG_SENSOR_SCHEMA],
         cv.Optional(CONF_GROUPS): [config_group_schema],
+        cv.Optional(CONF_FILTER_BANK): CONFIG_FILTER_BANK_SCHEMA,
+        cv.Optional(CONF_TAP): CONFIG_TAP_SCHEMA,
+    }
+)
+
+
+def check_fixed_point_coeffs(rows, name):
+    for row in rows:
+        if any(abs(c) >= MAX_FIXED_POINT_COEFF for c in row):
+            raise cv.Invalid(
+                f"Coefficients of {name} must be within (-{MAX_FIXED_POINT_COEFF}, "
+                f"{MAX_FIXED_POINT_COEFF}) when {CONF_FIXED_POINT} is enabled, "
+                f"got {row}"
+            )
+
+
+def validate_fixed_point_coeffs(groups):
+    for gc in groups:
+        for fc in gc.get(CONF_FILTERS, []):
+            rows = fc.get(CONF_COEFFS, [])
+            for sc in fc.get(CONF_SETS, []):
+                rows = rows + sc.get(CONF_COEFFS, [])
+            check_fixed_point_coeffs(rows, "SOS filter")
+        validate_fixed_point_coeffs(gc.get(CONF_GROUPS, []))
+
+
+def validate_fixed_point(config):
+    if config[CONF_FIXED_POINT]:
+        validate_fixed_point_coeffs(config[CONF_GROUPS])
+    return config
+
+
+CONFIG_PROFILING_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_CPU_LOAD): sensor.sensor_schema(
+            unit_of_measurement=UNIT_PERCENT,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(CONF_I2S_READ_WAIT): sensor.sensor_schema(
+            unit_of_measurement=UNIT_PERCENT,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(CONF_PUBLISH_LATENCY): sensor.sensor_schema(
+            unit_of_measurement=UNIT_MILLISECOND,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        # max time from detecting a threshold crossing till calling on_threshold
+        cv.Optional(CONF_THRESHOLD_LATENCY): sensor.sensor_schema(
+            unit_of_measurement=UNIT_MILLISECOND,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+    }
+)
+
+
+def validate_snapshot(config):
+    if config[CONF_DURATION].total_milliseconds == 0:
+        raise cv.Invalid(f"{CONF_DURATION} must be positive")
+    if config[CONF_POST_TRIGGER] > config[CONF_DURATION]:
+        raise cv.Invalid(f"{CONF_POST_TRIGGER} must not exceed {CONF_DURATION}")
+    return config
+
+
+# last seconds of input audio as int16 (2 bytes per sample, e.g. 960KB for 10s
+# at 48kHz), so it needs PSRAM for anything longer than a couple of seconds
+CONFIG_SNAPSHOT_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Required(CONF_DURATION): cv.positive_time_period_milliseconds,
+            cv.Optional(
+                CONF_POST_TRIGGER, default="0s"
+            ): cv.positive_time_period_milliseconds,
+        }
+    ),
+    validate_snapshot,
+)
+
+# values published by the sensors, about 3-4 bytes per value, e.g. ~350KB for
+# a day of one sensor updated every second
+CONFIG_HISTORY_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_SIZE): cv.int_range(min=1024),
+        cv.Required(CONF_SENSORS): cv.All(
+            cv.ensure_list(cv.use_id(sensor.Sensor)), cv.Length(min=1, max=255)
+        ),
+        cv.Optional(CONF_BATCH_SIZE, default=32): cv.int_range(1, 1024),
     }
 )
 
@@ -147,47 +655,345 @@ CONFIG_SCHEMA = cv.Schema(
         ): cv.positive_time_period_milliseconds,
         cv.Optional(CONF_IS_ON, default=True): cv.boolean,
         cv.Optional(CONF_BUFFER_SIZE, default=1024): cv.positive_not_null_int,
+        cv.Optional(CONF_BUFFER_COUNT, default=2): cv.int_range(2, 32),
+        cv.Optional(CONF_USE_PSRAM, default=False): cv.boolean,
+        cv.Optional(CONF_PUBLISH_QUEUE_SIZE, default=64): cv.positive_not_null_int,
+        cv.Optional(CONF_FIXED_POINT, default=False): cv.boolean,
+        cv.Optional(CONF_USE_ESP_DSP, default=False): cv.boolean,
         cv.Optional(
             CONF_WARMUP_INTERVAL, default="500ms"
         ): cv.positive_time_period_milliseconds,
         cv.Optional(CONF_TASK_STACK_SIZE, default=4096): cv.positive_not_null_int,
         cv.Optional(CONF_TASK_PRIORITY, default=2): cv.uint8_t,
         cv.Optional(CONF_TASK_CORE, default=1): cv.int_range(0, 1),
+        cv.Optional(CONF_READER_TASK_PRIORITY, default=3): cv.uint8_t,
+        cv.Optional(CONF_READER_TASK_CORE, default=1): cv.int_range(0, 1),
+        cv.Optional(CONF_WORKER_COUNT, default=1): cv.int_range(1, 4),
         cv.Optional(CONF_MIC_SENSITIVITY): cv.decibel,
         cv.Optional(CONF_MIC_SENSITIVITY_REF): cv.decibel,
         cv.Optional(CONF_OFFSET): cv.decibel,
+        cv.Optional(CONF_PROFILING): CONFIG_PROFILING_SCHEMA,
+        cv.Optional(CONF_DROPPED_SAMPLES): sensor.sensor_schema(
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(CONF_SAMPLE_LOSS_THRESHOLD, default="0%"): cv.percentage,
+        cv.Optional(CONF_ON_SAMPLE_LOSS): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(SampleLossTrigger)}
+        ),
+        cv.Optional(CONF_SNAPSHOT): CONFIG_SNAPSHOT_SCHEMA,
+        cv.Optional(CONF_ON_SNAPSHOT): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(SnapshotTrigger)}
+        ),
+        cv.Optional(CONF_HISTORY): CONFIG_HISTORY_SCHEMA,
+        cv.Optional(CONF_ON_HISTORY_EXPORT): automation.validate_automation(
+            {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(HistoryExportTrigger)}
+        ),
         cv.Required(CONF_GROUPS): [CONFIG_GROUP_SCHEMA],
     }
 ).extend(cv.COMPONENT_SCHEMA)
+CONFIG_SCHEMA = cv.All(CONFIG_SCHEMA, validate_fixed_point)
+
+
+def get_i2s_sample_rate(full_config, i2s_id):
+    for conf in full_config.get("i2s", []):
+        if conf[CONF_ID] == i2s_id:
+            return conf[i2s.CONF_SAMPLE_RATE]
+    return None
+
+
+def group_sample_rate(config, sample_rate):
+    """Sample rate after filters of the group, used by its sensors and subgroups"""
+    for fc in config.get(CONF_FILTERS, []):
+        if fc[CONF_TYPE] == CONF_DECIMATION:
+            sample_rate /= fc[CONF_FACTOR]
+    return sample_rate
+
+
+def validate_filter_banks(groups, sample_rate):
+    for gc in groups:
+        rate = group_sample_rate(gc, sample_rate)
+        if CONF_FILTER_BANK in gc:
+            for nominal, _, _, upper in filter_bank_bands(gc[CONF_FILTER_BANK]):
+                if upper >= MAX_BAND_UPPER_EDGE * rate:
+                    raise cv.Invalid(
+                        f"Band {format_frequency(nominal)} is too high for "
+                        f"sample rate of {rate:g}Hz"
+                    )
+        validate_filter_banks(gc.get(CONF_GROUPS, []), rate)
+
+
+def validate_weightings(groups, sample_rate):
+    for gc in groups:
+        rate = sample_rate
+        for fc in gc.get(CONF_FILTERS, []):
+            if fc[CONF_TYPE] == CONF_DECIMATION:
+                rate /= fc[CONF_FACTOR]
+            weightings = [fc.get(CONF_WEIGHTING)]
+            weightings += [sc.get(CONF_WEIGHTING) for sc in fc.get(CONF_SETS, [])]
+            for weighting in weightings:
+                if weighting in (None, "Z"):
+                    continue
+                cls = iec_61672_class(
+                    weighting_filter(weighting, rate), weighting, rate
+                )
+                if cls is None:
+                    raise cv.Invalid(
+                        f"{weighting}-weighting for sample rate of {rate:g}Hz is out "
+                        "of IEC 61672 class 2 tolerances"
+                    )
+                if cls != 1:
+                    _LOGGER.warning(
+                        "%s-weighting for sample rate of %gHz meets only "
+                        "IEC 61672 class %d",
+                        weighting,
+                        rate,
+                        cls,
+                    )
+        validate_weightings(gc.get(CONF_GROUPS, []), rate)
+
+
+def validate_designed_fixed_point_coeffs(groups, sample_rate):
+    """The same check as validate_fixed_point_coeffs() for filters designed at code
+    generation time, which depend on sample rate"""
+    for gc in groups:
+        rate = sample_rate
+        for fc in gc.get(CONF_FILTERS, []):
+            if fc[CONF_TYPE] == CONF_DECIMATION:
+                for m, taps in decimation_stages(fc[CONF_FACTOR]):
+                    check_fixed_point_coeffs([[t] for t in taps], f"decimation by {m}")
+                rate /= fc[CONF_FACTOR]
+            weightings = [fc.get(CONF_WEIGHTING)]
+            weightings += [sc.get(CONF_WEIGHTING) for sc in fc.get(CONF_SETS, [])]
+            for weighting in weightings:
+                if weighting not in (None, "Z"):
+                    check_fixed_point_coeffs(
+                        weighting_filter(weighting, rate),
+                        f"{weighting}-weighting for sample rate of {rate:g}Hz",
+                    )
+        if CONF_FILTER_BANK in gc:
+            for nominal, _, lower, upper in filter_bank_bands(gc[CONF_FILTER_BANK]):
+                level = filter_bank_level(upper, rate)
+                if level > 0:
+                    check_fixed_point_coeffs(
+                        butter_lowpass(DECIMATOR_ORDER, DECIMATOR_CUTOFF, 1),
+                        "filter bank decimator",
+                    )
+                check_fixed_point_coeffs(
+                    butter_bandpass(BAND_FILTER_ORDER, lower, upper, rate / 2**level),
+                    f"{format_frequency(nominal)} band filter",
+                )
+        validate_designed_fixed_point_coeffs(gc.get(CONF_GROUPS, []), rate)
+
+
+def validate_taps(groups, ports):
+    for gc in groups:
+        if CONF_TAP in gc:
+            port = gc[CONF_TAP][CONF_PORT]
+            if port in ports:
+                raise cv.Invalid(f"Port {port} is used by more than one tap")
+            ports.add(port)
+        validate_taps(gc.get(CONF_GROUPS, []), ports)
+    return ports
+
+
+def final_validate(config):
+    full_config = fv.full_config.get()
+    if validate_taps(config[CONF_GROUPS], set()) and "network" not in full_config:
+        # it still compiles, but there is nothing to listen on
+        _LOGGER.warning("%s requires wifi or ethernet", CONF_TAP)
+    sample_rate = get_i2s_sample_rate(full_config, config[CONF_I2S_ID])
+    if sample_rate is not None:
+        validate_filter_banks(config[CONF_GROUPS], sample_rate)
+        validate_weightings(config[CONF_GROUPS], sample_rate)
+        if config[CONF_FIXED_POINT]:
+            validate_designed_fixed_point_coeffs(config[CONF_GROUPS], sample_rate)
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = final_validate
 
 SOUND_LEVEL_METER_ACTION_SCHEMA = maybe_simple_id(
     {cv.GenerateID(): cv.use_id(SoundLevelMeter)}
 )
 
+GROUP_ACTION_SCHEMA = maybe_simple_id({cv.GenerateID(): cv.use_id(SensorGroup)})
+
+
+def sos_filter_to_code(id_, coeffs):
+    if len(coeffs) > MAX_FUSED_SOS_SECTIONS:
+        id_ = id_.copy()
+        id_.type = SOS_Filter
+        return cg.new_Pvariable(id_, coeffs)
+    return cg.new_Pvariable(id_, cg.TemplateArguments(len(coeffs)), coeffs)
+
+
+def switchable_filter_to_code(config, rate):
+    f = cg.new_Pvariable(config[CONF_ID])
+    for sc in config[CONF_SETS]:
+        if CONF_COEFFS in sc:
+            coeffs = sc[CONF_COEFFS]
+        elif sc[CONF_WEIGHTING] != "Z":
+            coeffs = weighting_filter(sc[CONF_WEIGHTING], rate)
+        else:
+            coeffs = []
+        cg.add(f.add_set(sc[CONF_NAME], coeffs))
+    cg.add(f.set_reset_state(config[CONF_RESET_STATE]))
+    if CONF_SETTLE_TIME in config:
+        cg.add(f.set_settle_time(config[CONF_SETTLE_TIME]))
+    return f
+
+
+async def sensors_to_code(config, component, group):
+    for sc in config:
+        s = await sensor.new_sensor(sc)
+        cg.add(s.set_parent(component))
+        # internal sensors that nothing subscribes to are not computed, unless they
+        # have an id, which could be used in lambdas
+        if sc.get(CONF_INTERNAL) and sc[CONF_ID].is_manual:
+            cg.add(s.set_referenced(True))
+        if CONF_WINDOW_SIZE in sc:
+            cg.add(s.set_window_size(sc[CONF_WINDOW_SIZE]))
+        if CONF_UPDATE_INTERVAL in sc:
+            cg.add(s.set_update_interval(sc[CONF_UPDATE_INTERVAL]))
+        if CONF_SLIDING_WINDOW in sc:
+            cg.add(s.set_sliding_window(sc[CONF_SLIDING_WINDOW]))
+        if CONF_PERCENTILE in sc:
+            cg.add(s.set_percentile(sc[CONF_PERCENTILE]))
+        if CONF_TIME_WEIGHTING in sc:
+            cg.add(s.set_time_weighting(sc[CONF_TIME_WEIGHTING]))
+            cg.add(s.set_statistic(sc[CONF_STATISTIC]))
+        if CONF_METRIC in sc:
+            await cg.register_component(s, sc)
+            cg.add(s.set_time(await cg.get_variable(sc[CONF_TIME_ID])))
+            cg.add(s.set_metric(EXPOSURE_METRICS[sc[CONF_METRIC]]))
+            cg.add(s.set_criterion_level(sc[CONF_CRITERION_LEVEL]))
+            cg.add(s.set_checkpoint_interval(sc[CONF_CHECKPOINT_INTERVAL]))
+            cg.add(s.set_day_start_hour(sc[CONF_DAY_START_HOUR]))
+        if CONF_THRESHOLD in sc:
+            tc = sc[CONF_THRESHOLD]
+            cg.add(s.set_threshold(tc[CONF_ABOVE]))
+            cg.add(s.set_threshold_duration(tc[CONF_FOR]))
+            cg.add(s.set_threshold_hysteresis(tc[CONF_HYSTERESIS]))
+            cg.add(s.set_publish_on_threshold(tc[CONF_PUBLISH]))
+        for conf in sc.get(CONF_ON_THRESHOLD, []):
+            trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], s)
+            await automation.build_automation(trigger, [(float, "x")], conf)
+        cg.add(group.add_sensor(s))
 
-async def groups_to_code(config, component, parent):
+
+def filter_bank_level(upper, sample_rate):
+    level = 0
+    while sample_rate / 2 ** (level + 1) >= BAND_DECIMATION_MARGIN * upper:
+        level += 1
+    return level
+
+
+async def filter_bank_to_code(config, component, sample_rate):
+    fb = cg.new_Pvariable(config[CONF_ID])
+    bank_id = config[CONF_ID].id
+    bands = filter_bank_bands(config)
+    levels = [filter_bank_level(upper, sample_rate) for _, _, _, upper in bands]
+    # decimator works at its input rate, so the same low pass filter fits every level
+    lowpass = butter_lowpass(DECIMATOR_ORDER, DECIMATOR_CUTOFF, 1)
+    for i in range(max(levels)):
+        id_ = ID(
+            f"{bank_id}_decimator_{i}", is_declaration=True, type=FusedSOS_Filter
+        )
+        cg.add(fb.add_decimator(sos_filter_to_code(id_, lowpass)))
+    for (nominal, _, lower, upper), level, sensors in zip(
+        bands, levels, config[CONF_BAND_SENSORS]
+    ):
+        name = format_frequency(nominal)
+        suffix = name.lower().replace(".", "_")
+        g = cg.new_Pvariable(
+            ID(f"{bank_id}_{suffix}", is_declaration=True, type=SensorGroup)
+        )
+        cg.add(g.set_parent(component))
+        rate = sample_rate / 2**level
+        coeffs = butter_bandpass(BAND_FILTER_ORDER, lower, upper, rate)
+        id_ = ID(
+            f"{bank_id}_{suffix}_filter", is_declaration=True, type=FusedSOS_Filter
+        )
+        cg.add(g.add_filter(sos_filter_to_code(id_, coeffs)))
+        await sensors_to_code(sensors, component, g)
+        cg.add(fb.add_band(name, level, g))
+    return fb
+
+
+def decimation_filters_to_code(id_, factor):
+    """Decimation is split into stages, each of them is a separate filter"""
+    filters = []
+    for i, (m, taps) in enumerate(decimation_stages(factor)):
+        stage_id = id_
+        if i > 0:
+            stage_id = ID(f"{id_.id}_{i}", is_declaration=True, type=DecimationFilter)
+        filters.append(cg.new_Pvariable(stage_id, m, taps))
+    return filters
+
+
+def filter_key(config):
+    if config[CONF_TYPE] == CONF_SOS:
+        return (CONF_SOS, tuple(tuple(row) for row in config[CONF_COEFFS]))
+    if config[CONF_TYPE] == CONF_WEIGHTING:
+        return (CONF_WEIGHTING, config[CONF_WEIGHTING])
+    # each switchable filter is switched on its own, so it is never shared
+    if config[CONF_TYPE] == CONF_SWITCHABLE:
+        return (CONF_SWITCHABLE, config[CONF_ID].id)
+    return (config[CONF_TYPE], config[CONF_FACTOR])
+
+
+async def groups_to_code(config, component, parent, sample_rate):
+    # filters created for each prefix of filter keys of siblings: a group starting with
+    # the same filters as an earlier sibling gets the same objects, so that in C++ they
+    # are run once for both of them (see SensorGroup::share_filters())
+    shared = {}
     for gc in config:
         g = cg.new_Pvariable(gc[CONF_ID])
         cg.add(g.set_parent(component))
         cg.add(parent.add_group(g))
-        if CONF_FILTERS in gc:
-            for fc in gc[CONF_FILTERS]:
-                f = None
-                if fc[CONF_TYPE] == CONF_SOS:
-                    f = cg.new_Pvariable(fc[CONF_ID], fc[CONF_COEFFS])
-                if f is not None:
-                    cg.add(g.add_filter(f))
+        if not gc[CONF_IS_ON]:
+            cg.add(g.turn_off())
+        rate = sample_rate
+        prefix = ()
+        for fc in gc.get(CONF_FILTERS, []):
+            prefix += (filter_key(fc),)
+            filters = []
+            if prefix in shared:
+                filters = shared[prefix]
+                if filters:
+                    # the id still refers to the filter, e.g. from lambdas
+                    cg.Pvariable(fc[CONF_ID], filters[0], type_=Filter)
+            elif fc[CONF_TYPE] == CONF_SOS:
+                filters = [sos_filter_to_code(fc[CONF_ID], fc[CONF_COEFFS])]
+            elif fc[CONF_TYPE] == CONF_DECIMATION:
+                filters = decimation_filters_to_code(fc[CONF_ID], fc[CONF_FACTOR])
+            elif fc[CONF_TYPE] == CONF_WEIGHTING and fc[CONF_WEIGHTING] != "Z":
+                coeffs = weighting_filter(fc[CONF_WEIGHTING], rate)
+                filters = [sos_filter_to_code(fc[CONF_ID], coeffs)]
+            elif fc[CONF_TYPE] == CONF_SWITCHABLE:
+                filters = [switchable_filter_to_code(fc, rate)]
+            shared[prefix] = filters
+            if fc[CONF_TYPE] == CONF_DECIMATION:
+                rate /= fc[CONF_FACTOR]
+            for f in filters:
+                cg.add(g.add_filter(f))
         if CONF_GROUPS in gc:
-            await groups_to_code(gc[CONF_GROUPS], component, g)
+            await groups_to_code(gc[CONF_GROUPS], component, g, rate)
         if CONF_SENSORS in gc:
-            for sc in gc[CONF_SENSORS]:
-                s = await sensor.new_sensor(sc)
-                cg.add(s.set_parent(component))
-                if CONF_WINDOW_SIZE in sc:
-                    cg.add(s.set_window_size(sc[CONF_WINDOW_SIZE]))
-                if CONF_UPDATE_INTERVAL in sc:
-                    cg.add(s.set_update_interval(sc[CONF_UPDATE_INTERVAL]))
-                cg.add(g.add_sensor(s))
+            await sensors_to_code(gc[CONF_SENSORS], component, g)
+        if CONF_FILTER_BANK in gc:
+            fb = await filter_bank_to_code(gc[CONF_FILTER_BANK], component, rate)
+            cg.add(g.set_filter_bank(fb))
+        if CONF_TAP in gc:
+            # sockets and the sender task are compiled in only when some group has a tap
+            cg.add_define("USE_SOUND_LEVEL_METER_TAP")
+            tc = gc[CONF_TAP]
+            tap = cg.new_Pvariable(tc[CONF_ID])
+            cg.add(tap.set_port(tc[CONF_PORT]))
+            cg.add(tap.set_buffer_count(tc[CONF_BUFFER_COUNT]))
+            cg.add(g.set_tap(tap))
 
 
 async def to_code(config):
@@ -197,10 +1003,22 @@ async def to_code(config):
     cg.add(var.set_i2s(i2s_component))
     cg.add(var.set_update_interval(config[CONF_UPDATE_INTERVAL]))
     cg.add(var.set_buffer_size(config[CONF_BUFFER_SIZE]))
+    cg.add(var.set_buffer_count(config[CONF_BUFFER_COUNT]))
+    cg.add(var.set_use_psram(config[CONF_USE_PSRAM]))
+    cg.add(var.set_publish_queue_size(config[CONF_PUBLISH_QUEUE_SIZE]))
+    cg.add(var.set_fixed_point(config[CONF_FIXED_POINT]))
+    if config[CONF_USE_ESP_DSP]:
+        cg.add_define("USE_SOUND_LEVEL_METER_ESP_DSP")
+        # arduino framework has esp-dsp built in
+        if CORE.using_esp_idf:
+            esp32.add_idf_component(name="espressif/esp-dsp", ref="1.4.12")
     cg.add(var.set_warmup_interval(config[CONF_WARMUP_INTERVAL]))
     cg.add(var.set_task_stack_size(config[CONF_TASK_STACK_SIZE]))
     cg.add(var.set_task_priority(config[CONF_TASK_PRIORITY]))
     cg.add(var.set_task_core(config[CONF_TASK_CORE]))
+    cg.add(var.set_reader_task_priority(config[CONF_READER_TASK_PRIORITY]))
+    cg.add(var.set_reader_task_core(config[CONF_READER_TASK_CORE]))
+    cg.add(var.set_worker_count(config[CONF_WORKER_COUNT]))
     if CONF_MIC_SENSITIVITY in config:
         cg.add(var.set_mic_sensitivity(config[CONF_MIC_SENSITIVITY]))
     if CONF_MIC_SENSITIVITY_REF in config:
@@ -209,9 +1027,95 @@ async def to_code(config):
         cg.add(var.set_offset(config[CONF_OFFSET]))
     if not config[CONF_IS_ON]:
         cg.add(var.turn_off())
-    await groups_to_code(config[CONF_GROUPS], var, var)
+    if CONF_DROPPED_SAMPLES in config:
+        s = await sensor.new_sensor(config[CONF_DROPPED_SAMPLES])
+        cg.add(var.set_dropped_samples_sensor(s))
+    cg.add(var.set_sample_loss_threshold(config[CONF_SAMPLE_LOSS_THRESHOLD] * 100))
+    for conf in config.get(CONF_ON_SAMPLE_LOSS, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(float, "loss")], conf)
+    if CONF_SNAPSHOT in config:
+        sc = config[CONF_SNAPSHOT]
+        cg.add(var.set_snapshot_duration(sc[CONF_DURATION]))
+        cg.add(var.set_snapshot_post_trigger(sc[CONF_POST_TRIGGER]))
+    for conf in config.get(CONF_ON_SNAPSHOT, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [], conf)
+    if CONF_PROFILING in config:
+        # timing code is compiled in only when asked for, so it costs nothing otherwise
+        cg.add_define("USE_SOUND_LEVEL_METER_PROFILING")
+        pc = config[CONF_PROFILING]
+        if CONF_CPU_LOAD in pc:
+            s = await sensor.new_sensor(pc[CONF_CPU_LOAD])
+            cg.add(var.set_cpu_load_sensor(s))
+        if CONF_I2S_READ_WAIT in pc:
+            s = await sensor.new_sensor(pc[CONF_I2S_READ_WAIT])
+            cg.add(var.set_i2s_read_wait_sensor(s))
+        if CONF_PUBLISH_LATENCY in pc:
+            s = await sensor.new_sensor(pc[CONF_PUBLISH_LATENCY])
+            cg.add(var.set_publish_latency_sensor(s))
+        if CONF_THRESHOLD_LATENCY in pc:
+            s = await sensor.new_sensor(pc[CONF_THRESHOLD_LATENCY])
+            cg.add(var.set_threshold_latency_sensor(s))
+    sample_rate = get_i2s_sample_rate(CORE.config, config[CONF_I2S_ID])
+    await groups_to_code(config[CONF_GROUPS], var, var, sample_rate)
+    # after groups, as history usually records sensors of this component
+    if CONF_HISTORY in config:
+        hc = config[CONF_HISTORY]
+        cg.add(var.set_history_size(hc[CONF_SIZE]))
+        cg.add(var.set_history_batch_size(hc[CONF_BATCH_SIZE]))
+        for sensor_id in hc[CONF_SENSORS]:
+            s = await cg.get_variable(sensor_id)
+            cg.add(var.add_history_sensor(s))
+    for conf in config.get(CONF_ON_HISTORY_EXPORT, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(
+            trigger, [(cg.std_vector.template(HistoryRecord), "x")], conf
+        )
 
 
+@automation.register_action(
+    "sound_level_meter.group.toggle",
+    GroupToggleAction,
+    GROUP_ACTION_SCHEMA,
+    synchronous=True,
+)
+@automation.register_action(
+    "sound_level_meter.group.turn_off",
+    GroupTurnOffAction,
+    GROUP_ACTION_SCHEMA,
+    synchronous=True,
+)
+@automation.register_action(
+    "sound_level_meter.group.turn_on",
+    GroupTurnOnAction,
+    GROUP_ACTION_SCHEMA,
+    synchronous=True,
+)
+@automation.register_action(
+    "sound_level_meter.export_history",
+    ExportHistoryAction,
+    SOUND_LEVEL_METER_ACTION_SCHEMA,
+    synchronous=True,
+)
+@automation.register_action(
+    "sound_level_meter.release_snapshot",
+    ReleaseSnapshotAction,
+    SOUND_LEVEL_METER_ACTION_SCHEMA,
+    synchronous=True,
+)
+@automation.register_action(
+    "sound_level_meter.take_snapshot",
+    TakeSnapshotAction,
+    SOUND_LEVEL_METER_ACTION_SCHEMA,
+    synchronous=True,
+)
+@automation.register_action(
+    "sound_level_meter.dump_profile",
+    DumpProfileAction,
+    SOUND_LEVEL_METER_ACTION_SCHEMA,
+    synchronous=True,
+)
 @automation.register_action(
     "sound_level_meter.toggle",
     ToggleAction,
@@ -233,3 +1137,33 @@ async def to_code(config):
 async def switch_toggle_to_code(config, action_id, template_arg, args):
     paren = await cg.get_variable(config[CONF_ID])
     return cg.new_Pvariable(action_id, template_arg, paren)
+
+
+@automation.register_action(
+    "sound_level_meter.filter.set_coeffs",
+    SetCoeffsAction,
+    cv.All(
+        cv.Schema(
+            {
+                cv.GenerateID(): cv.use_id(SwitchableSOS_Filter),
+                cv.Exclusive(CONF_SET, "source"): cv.templatable(cv.string_strict),
+                # runtime coefficients, at most as many sections as the longest set
+                cv.Exclusive(CONF_COEFFS, "source"): cv.returning_lambda,
+            }
+        ),
+        cv.has_exactly_one_key(CONF_SET, CONF_COEFFS),
+    ),
+    synchronous=True,
+)
+async def set_coeffs_to_code(config, action_id, template_arg, args):
+    paren = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, paren)
+    if CONF_SET in config:
+        set_name = await cg.templatable(config[CONF_SET], args, cg.std_string)
+        cg.add(var.set_set_name(set_name))
+    else:
+        coeffs = await cg.process_lambda(
+            config[CONF_COEFFS], args, return_type=SOSCoeffs
+        )
+        cg.add(var.set_coeffs(coeffs))
+    return var
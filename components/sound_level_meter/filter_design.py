@@ -0,0 +1,378 @@
+# Pure Python IIR filter design used at code generation time: numpy/scipy are not
+# available in ESPHome environment, and filters here are small enough to design by hand.
+# All functions return second order sections as [b0, b1, b2, a1, a2] rows (a0 = 1),
+# the same format as `sos` filter coeffs in the config.
+
+import cmath
+import math
+import struct
+import sys
+
+# IEC 61260-1 base-10 octave ratio
+OCTAVE_RATIO = 10 ** (3 / 10)
+
+# nominal mid-band frequencies of 1/3 octave bands (every third one is an octave band)
+NOMINAL_FREQUENCIES = [
+    10, 12.5, 16, 20, 25, 31.5, 40, 50, 63, 80, 100, 125, 160, 200, 250, 315, 400, 500, 630, 800,
+    1000, 1250, 1600, 2000, 2500, 3150, 4000, 5000, 6300, 8000, 10000, 12500, 16000, 20000,
+]  # fmt: skip
+
+
+def format_frequency(f):
+    if f >= 1000:
+        return f"{f / 1000:g}kHz"
+    return f"{f:g}Hz"
+
+
+def fractional_octave_bands(fraction, min_frequency, max_frequency):
+    """Returns (nominal, mid, lower edge, upper edge) for 1/fraction octave bands
+    with nominal mid-band frequencies within [min_frequency, max_frequency]"""
+    bands = []
+    for nominal in NOMINAL_FREQUENCIES:
+        # band index relative to 1kHz in 1/3 octave steps
+        x = round(3 * math.log(nominal / 1000, OCTAVE_RATIO))
+        if fraction == 1 and x % 3 != 0:
+            continue
+        if not min_frequency <= nominal <= max_frequency:
+            continue
+        mid = 1000 * OCTAVE_RATIO ** (x / 3)
+        half_band = OCTAVE_RATIO ** (1 / (2 * fraction))
+        bands.append((nominal, mid, mid / half_band, mid * half_band))
+    return bands
+
+
+def _prewarp(f, fs):
+    return 2 * fs * math.tan(math.pi * f / fs)
+
+
+def _bilinear(s, fs):
+    return (2 * fs + s) / (2 * fs - s)
+
+
+def _butter_prototype_poles(order):
+    return [
+        cmath.exp(1j * math.pi * (2 * k + order + 1) / (2 * order))
+        for k in range(order)
+    ]
+
+
+def _sections(poles, b):
+    """Builds one section per pair of complex conjugate digital poles with numerator b,
+    least resonant sections go first"""
+    upper = sorted((p for p in poles if p.imag > 0), key=abs)
+    return [[*b, -2 * p.real, abs(p) ** 2] for p in upper]
+
+
+def sos_response(sos, f, fs):
+    """Complex frequency response of SOS cascade at frequency f"""
+    z1 = cmath.exp(-2j * math.pi * f / fs)
+    h = 1
+    for b0, b1, b2, a1, a2 in sos:
+        h *= (b0 + b1 * z1 + b2 * z1 * z1) / (1 + a1 * z1 + a2 * z1 * z1)
+    return h
+
+
+def _normalize(sos, f, fs):
+    """Scales numerator of every section to unity gain at frequency f,
+    so that intermediate results stay in range (important for fixed point)"""
+    for row in sos:
+        g = abs(sos_response([row], f, fs))
+        row[0], row[1], row[2] = row[0] / g, row[1] / g, row[2] / g
+    return sos
+
+
+def butter_lowpass(order, cutoff, fs):
+    """Digital Butterworth low pass filter, order must be even"""
+    wc = _prewarp(cutoff, fs)
+    poles = [_bilinear(wc * p, fs) for p in _butter_prototype_poles(order)]
+    # all zeros are at s = inf, i.e. z = -1
+    return _normalize(_sections(poles, [1, 2, 1]), 0, fs)
+
+
+def butter_bandpass(order, f1, f2, fs):
+    """Digital Butterworth band pass filter of 2 * order, i.e. with order sections"""
+    w1, w2 = _prewarp(f1, fs), _prewarp(f2, fs)
+    w0, bw = math.sqrt(w1 * w2), w2 - w1
+    poles = []
+    # low pass to band pass transformation: s -> (s^2 + w0^2) / (s * bw),
+    # every prototype pole p gives roots of s^2 - p * bw * s + w0^2
+    for p in _butter_prototype_poles(order):
+        d = cmath.sqrt((p * bw) ** 2 - 4 * w0 * w0)
+        poles += [_bilinear((p * bw + d) / 2, fs), _bilinear((p * bw - d) / 2, fs)]
+    # half of zeros are at s = 0 (z = 1) and half at s = inf (z = -1)
+    f0 = math.atan(w0 / (2 * fs)) * fs / math.pi
+    return _normalize(_sections(poles, [1, 0, -1]), f0, fs)
+
+
+def _bessel_i0(x):
+    s, term, k = 1, 1, 1
+    while term > 1e-12 * s:
+        term *= (x / (2 * k)) ** 2
+        s += term
+        k += 1
+    return s
+
+
+def kaiser_lowpass(cutoff, transition, attenuation, fs):
+    """Linear phase FIR low pass filter designed with Kaiser window method,
+    returns odd number of symmetric taps"""
+    beta = 0.1102 * (attenuation - 8.7)
+    n = math.ceil((attenuation - 8) / (2.285 * 2 * math.pi * transition / fs))
+    delay = (n + 1) // 2
+    taps = []
+    for k in range(-delay, delay + 1):
+        x = 2 * cutoff / fs * k
+        h = 2 * cutoff / fs * (math.sin(math.pi * x) / (math.pi * x) if k else 1)
+        w = _bessel_i0(beta * math.sqrt(1 - (k / delay) ** 2)) / _bessel_i0(beta)
+        taps.append(h * w)
+    # unity gain at DC
+    s = sum(taps)
+    return [h / s for h in taps]
+
+
+def decimation_stages(factor, attenuation=80):
+    """Splits decimation into stages: halfband filters for every factor of 2 (cheap and
+    done first, at the highest rates), then one stage for the remaining odd factor.
+    Every stage passes 0.4 of its output rate, and aliases within that band are
+    attenuated by about the given number of dB (Kaiser's length estimate is
+    approximate, see decimation_attenuation). Returns list of (factor, taps)"""
+    stages = []
+    fs = 1.0
+    while factor % 2 == 0:
+        stages.append(2)
+        factor //= 2
+    if factor > 1:
+        stages.append(factor)
+    result = []
+    for m in stages:
+        out = fs / m
+        taps = kaiser_lowpass(out / 2, 0.2 * out, attenuation, fs)
+        # every m-th tap from the center is zero by design (m = 2 is a halfband filter),
+        # make it exact, so that they are skipped
+        delay = len(taps) // 2
+        for k in range(len(taps)):
+            if k != delay and (k - delay) % m == 0:
+                taps[k] = 0
+        if m == 2:
+            taps[delay] = 0.5
+        result.append((m, taps))
+        fs = out
+    return result
+
+
+# IEC 61672-1 analog A and C weighting: double pole at F1, double pole at F4,
+# A adds single poles at F2 and F3, all zeros are at s = 0
+WEIGHTING_F1 = 20.598997
+WEIGHTING_F2 = 107.65265
+WEIGHTING_F3 = 737.86223
+WEIGHTING_F4 = 12194.217
+
+# IEC 61672-1:2013 class 1 and class 2 (upper, lower) tolerance limits in dB
+# for NOMINAL_FREQUENCIES, None means no lower limit
+IEC_61672_TOLERANCES = {
+    1: [
+        (3.5, None), (3.0, None), (2.5, -4.5), (2.5, -2.5), (2.5, -2.5), (2.0, -2.0),
+        (1.5, -1.5), (1.5, -1.5), (1.5, -1.5), (1.5, -1.5), (1.5, -1.5), (1.5, -1.5),
+        (1.5, -1.5), (1.5, -1.5), (1.4, -1.4), (1.4, -1.4), (1.4, -1.4), (1.4, -1.4),
+        (1.4, -1.4), (1.4, -1.4), (1.1, -1.1), (1.4, -1.4), (1.4, -1.4), (1.6, -1.6),
+        (1.6, -1.6), (1.6, -1.6), (1.6, -1.6), (2.1, -2.1), (2.1, -2.6), (2.1, -3.1),
+        (2.6, -3.6), (3.0, -6.0), (3.5, -17.0), (4.0, None),
+    ],
+    2: [
+        (5.5, None), (5.5, None), (5.5, None), (3.5, -3.5), (3.5, -3.5), (3.5, -3.5),
+        (2.5, -2.5), (2.5, -2.5), (2.5, -2.5), (2.5, -2.5), (2.0, -2.0), (2.0, -2.0),
+        (2.0, -2.0), (2.0, -2.0), (1.9, -1.9), (1.9, -1.9), (1.9, -1.9), (1.9, -1.9),
+        (1.9, -1.9), (1.9, -1.9), (1.4, -1.4), (1.9, -1.9), (2.6, -2.6), (2.6, -2.6),
+        (3.1, -3.1), (3.1, -3.1), (3.6, -3.6), (4.1, -4.1), (5.1, -5.1), (5.6, -5.6),
+        (6.0, None), (6.0, None), (6.0, None), (6.0, None),
+    ],
+}  # fmt: skip
+
+WEIGHTINGS = ["A", "C", "Z"]
+
+
+def analog_weighting_db(weighting, f):
+    """Level of IEC 61672-1 frequency weighting at frequency f relative to 1kHz"""
+
+    def response(f):
+        s = 2j * math.pi * f
+        w1, w4 = 2 * math.pi * WEIGHTING_F1, 2 * math.pi * WEIGHTING_F4
+        h = (w4 * s) ** 2 / ((s + w1) * (s + w4)) ** 2
+        if weighting == "A":
+            w2, w3 = 2 * math.pi * WEIGHTING_F2, 2 * math.pi * WEIGHTING_F3
+            h *= s * s / ((s + w2) * (s + w3))
+        return abs(h)
+
+    if weighting == "Z":
+        return 0
+    return 20 * math.log10(response(f) / response(1000))
+
+
+def _db(h):
+    return 20 * math.log10(abs(h))
+
+
+def _solve(m, v):
+    """Solves linear system m * x = v with Gauss-Jordan elimination"""
+    n = len(v)
+    m = [row[:] + [v[i]] for i, row in enumerate(m)]
+    for c in range(n):
+        p = max(range(c, n), key=lambda r: abs(m[r][c]))
+        m[c], m[p] = m[p], m[c]
+        for r in range(n):
+            if r != c:
+                k = m[r][c] / m[c][c]
+                for j in range(c, n + 1):
+                    m[r][j] -= k * m[c][j]
+    return [m[i][n] / m[i][i] for i in range(n)]
+
+
+def _fit_section(row, target_db, freqs, fs):
+    """Adjusts single section to match target magnitude in dB at given frequencies:
+    Levenberg-Marquardt least squares fit of log magnitude, poles are kept stable.
+    Serves the same purpose as invfreqz in math/dsptools.py, but fits magnitude only"""
+
+    def residuals(row):
+        return [
+            _db(sos_response([row], f, fs)) - t
+            for f, t in zip(freqs, target_db)
+        ]
+
+    def stable(row):
+        return abs(row[4]) < 1 and abs(row[3]) < 1 + row[4]
+
+    r = residuals(row)
+    err = sum(x * x for x in r)
+    lam = 1e-3
+    for _ in range(100):
+        jac = []
+        for k in range(5):
+            d = 1e-7 * max(1, abs(row[k]))
+            moved = row[:]
+            moved[k] += d
+            jac.append([(a - b) / d for a, b in zip(residuals(moved), r)])
+        jtj = [[sum(a * b for a, b in zip(ji, jj)) for jj in jac] for ji in jac]
+        jtr = [sum(a * b for a, b in zip(ji, r)) for ji in jac]
+        while True:
+            m = [
+                [x * (1 + lam) if i == j else x for j, x in enumerate(jtj[i])]
+                for i in range(5)
+            ]
+            new_row = [a - b for a, b in zip(row, _solve(m, jtr))]
+            if stable(new_row):
+                new_r = residuals(new_row)
+                new_err = sum(x * x for x in new_r)
+                if new_err < err:
+                    break
+            lam *= 10
+            if lam > 1e10:
+                return row
+        converged = err - new_err < 1e-12 * err
+        row, r, err = new_row, new_r, new_err
+        lam = max(lam / 10, 1e-12)
+        if converged:
+            break
+    return row
+
+
+def weighting_filter(weighting, fs):
+    """IEC 61672-1 A, C or Z (no filter) frequency weighting for sample rate fs.
+    Low frequency poles are mapped with bilinear transform (warping is negligible
+    there), and double pole at F4 is replaced with a section fitted to the remaining
+    response up to 0.9 of Nyquist: bilinear transform would squeeze it towards Nyquist,
+    which is noticeable at 48kHz and is out of tolerance at 16kHz"""
+    if weighting == "Z":
+        return []
+    p1 = _bilinear(-2 * math.pi * WEIGHTING_F1, fs)
+    sos = [[1, -2, 1, -2 * p1, p1 * p1]]
+    if weighting == "A":
+        p2 = _bilinear(-2 * math.pi * WEIGHTING_F2, fs)
+        p3 = _bilinear(-2 * math.pi * WEIGHTING_F3, fs)
+        sos.append([1, -1, 0, -(p2 + p3), p2 * p3])
+    _normalize(sos, 1000, fs)
+    top = min(NOMINAL_FREQUENCIES[-1], 0.45 * fs)
+    freqs = [10 * (top / 10) ** (i / 59) for i in range(60)]
+    target = [
+        analog_weighting_db(weighting, f) - _db(sos_response(sos, f, fs)) for f in freqs
+    ]
+    # start from impulse invariant double pole with unity gain at DC
+    p4 = math.exp(-2 * math.pi * WEIGHTING_F4 / fs)
+    sos.append(_fit_section([(1 - p4) ** 2, 0, 0, -2 * p4, p4 * p4], target, freqs, fs))
+    return _normalize(sos, 1000, fs)
+
+
+def _float32(x):
+    return struct.unpack("f", struct.pack("f", x))[0]
+
+
+def weighting_deviations(sos, weighting, fs):
+    """(nominal frequency, deviation in dB) of filter from IEC 61672-1 weighting
+    for all nominal frequencies below Nyquist, with coefficients rounded to float
+    as they are on device"""
+    sos = [[_float32(c) for c in row] for row in sos]
+    return [
+        (f, _db(sos_response(sos, f, fs)) - analog_weighting_db(weighting, f))
+        for f in NOMINAL_FREQUENCIES
+        if f < fs / 2
+    ]
+
+
+def iec_61672_class(sos, weighting, fs):
+    """Best IEC 61672-1 class (1 or 2) which tolerances the filter meets at all
+    nominal frequencies below Nyquist, None if neither"""
+    deviations = weighting_deviations(sos, weighting, fs)
+    for cls, tolerances in IEC_61672_TOLERANCES.items():
+        if all(
+            (lower is None or lower <= d) and d <= upper
+            for (_, d), (upper, lower) in zip(deviations, tolerances)
+        ):
+            return cls
+    return None
+
+
+def fir_response(taps, f, fs):
+    """Complex frequency response of FIR filter at frequency f"""
+    return sum(h * cmath.exp(-2j * math.pi * f / fs * k) for k, h in enumerate(taps))
+
+
+# decimation stages are accepted if aliases are attenuated at most that much less
+# than asked for, Kaiser's estimate of the length is off by about 1dB
+DECIMATION_ATTENUATION_MARGIN = 1.5
+
+
+def decimation_attenuation(m, taps):
+    """Worst attenuation in dB of frequencies that alias into the passband of a stage
+    from decimation_stages. Ripples of window designs are largest next to the
+    transition band, so only the first 8 of them are scanned"""
+    edge = 0.6 / m
+    width = 8 / len(taps)
+    return -max(_db(fir_response(taps, edge + width * i / 128, 1)) for i in range(129))
+
+
+if __name__ == "__main__":
+    # host check of generated weightings and decimation stages:
+    # python3 filter_design.py [SAMPLE_RATE...]
+    rates = [int(x) for x in sys.argv[1:]] or [16000, 22050, 32000, 44100, 48000, 96000]
+    failed = False
+    for fs in rates:
+        for weighting in WEIGHTINGS[:2]:
+            sos = weighting_filter(weighting, fs)
+            cls = iec_61672_class(sos, weighting, fs)
+            deviations = weighting_deviations(sos, weighting, fs)
+            f, worst = max(deviations, key=lambda x: abs(x[1]))
+            print(
+                f"{fs:>6}Hz {weighting}: IEC 61672 class {cls or '-'}, "
+                f"max deviation {worst:+.3f}dB at {format_frequency(f)}"
+            )
+            failed |= cls != 1
+    # every decimation factor is made of the halfband stage and one odd stage, which
+    # depend only on their own factor
+    for m in [2] + list(range(3, 65, 2)):
+        taps = decimation_stages(m)[-1][1]
+        attenuation = decimation_attenuation(m, taps)
+        print(
+            f"decimation by {m:>2}: {len(taps)} taps, "
+            f"aliases attenuated by {attenuation:.1f}dB"
+        )
+        failed |= attenuation < 80 - DECIMATION_ATTENUATION_MARGIN
+    sys.exit(1 if failed else 0)
@@ -1,4 +1,15 @@
 #include "sound_level_meter.h"
+#include <cstring>
+#ifdef USE_SOUND_LEVEL_METER_TAP
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#ifdef USE_SOUND_LEVEL_METER_ESP_DSP
+#include "esp_dsp.h"
+#endif
 
 namespace esphome {
 namespace sound_level_meter {
@@ -12,19 +23,121 @@ static const char *const TAG = "sound_level_meter";
 // see: https://dsp.stackexchange.com/a/50947/65262
 static constexpr float DBFS_OFFSET = 20 * log10(sqrt(2));
 
+// reader task only copies data from I2S driver, so it doesn't need much stack
+static const uint32_t READER_TASK_STACK_SIZE = 3072;
+// top level groups are redistributed between workers every that many blocks
+static const uint32_t BALANCE_INTERVAL_BLOCKS = 32;
+static const float GROUP_COST_SMOOTHING = 0.1f;
+// rate at which time weighted sensors update their exponential filter
+static const float TIME_WEIGHTING_ENVELOPE_RATE = 1000.f;
+// rough number of operations the sensors kernel of a group spends per sample (squaring and summation
+// if any sensor needs energy, abs and compare for peak), used only for the cost estimate in dump_config
+static const float ENERGY_COST_PER_SAMPLE = 2.f;
+static const float PEAK_COST_PER_SAMPLE = 1.f;
+// threshold crossings are rare, each sensor triggers at most once until re-armed
+static const size_t THRESHOLD_QUEUE_SIZE = 8;
+// number of independent accumulators in sensor kernels
+static const size_t KERNEL_LANES = 4;
+#ifdef USE_SOUND_LEVEL_METER_TAP
+// sender task of a tap only does blocking socket calls
+static const uint32_t TAP_TASK_STACK_SIZE = 3072;
+// client that doesn't read for that long is disconnected, so that the next one could connect
+static const uint32_t TAP_SEND_TIMEOUT_MS = 5000;
+static const uint32_t TAP_RETRY_INTERVAL_MS = 5000;
+// while no blocks arrive (group or meter turned off) the client is polled that often to notice a disconnect
+static const uint32_t TAP_IDLE_CHECK_INTERVAL_MS = 1000;
+#endif
+
+// blocks of history are small, so that an overwrite loses few records, but big enough that absolute
+// values at the start of every block don't add much. Block header: start time (ms), used bytes, records
+static const size_t HISTORY_BLOCK_SIZE = 512;
+static const size_t HISTORY_BLOCK_HEADER_SIZE = 8;
+// sensor index, time and value varints
+static const size_t HISTORY_MAX_RECORD_SIZE = 1 + 5 + 5;
+static const uint32_t HISTORY_TIME_UNIT_MS = 10;
+// values are stored in 0.01dB, larger ones are stored as NAN
+static const float HISTORY_VALUE_SCALE = 100.f;
+static const float HISTORY_MAX_VALUE = 1e7f;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+int32_t to_fixed_point(float value, uint8_t frac_bits) {
+  double v = std::round(std::ldexp(double(value), frac_bits));
+  return int32_t(std::max<double>(INT32_MIN, std::min<double>(INT32_MAX, v)));
+}
+
+std::array<int32_t, 7> to_fixed_point_section(const std::array<float, 5> &coeffs) {
+  std::array<int32_t, 7> c;
+  for (size_t k = 0; k < 5; k++)
+    c[k] = to_fixed_point(coeffs[k], FIXED_POINT_COEFF_FRAC_BITS);
+  c[5] = -std::lround(coeffs[3]);
+  c[6] = -std::lround(coeffs[4]);
+  return c;
+}
+
+/* I2SSampleSource */
+
+#ifndef USE_HOST
+uint32_t I2SSampleSource::get_sample_rate() { return this->i2s_->get_sample_rate(); }
+bool I2SSampleSource::read_samples(float *data, size_t num_samples, size_t *samples_read) {
+  return this->i2s_->read_samples(data, num_samples, samples_read);
+}
+
+bool I2SSampleSource::read_samples(int32_t *data, size_t num_samples, size_t *samples_read) {
+  bool is_16bit = this->i2s_->get_bits_per_sample() <= 16;
+  bool ok;
+  if (is_16bit)
+    ok = this->i2s_->read_samples(reinterpret_cast<int16_t *>(data), num_samples, samples_read);
+  else
+    ok = this->i2s_->read_samples(data, num_samples, samples_read);
+  if (!ok)
+    return false;
+
+  // align samples so that full scale of the microphone becomes full scale of fixed point format
+  int sample_bits = (is_16bit ? 15 : 31) - this->i2s_->get_bits_shift();
+  int shift = FIXED_POINT_FRAC_BITS - sample_bits;
+  if (is_16bit) {
+    int16_t *data_i16 = reinterpret_cast<int16_t *>(data);
+    for (int i = *samples_read - 1; i >= 0; i--)
+      data[i] = int32_t(uint32_t(int32_t(data_i16[i])) << shift);
+  } else if (shift > 0) {
+    for (int i = 0; i < *samples_read; i++)
+      data[i] = int32_t(uint32_t(data[i]) << shift);
+  } else if (shift < 0) {
+    for (int i = 0; i < *samples_read; i++)
+      data[i] >>= -shift;
+  }
+  return true;
+}
+
+uint32_t I2SSampleSource::get_dropped_samples() { return this->i2s_->get_dropped_samples(); }
+#endif
+
 /* SoundLevelMeter */
 
 void SoundLevelMeter::set_update_interval(uint32_t update_interval) { this->update_interval_ = update_interval; }
 uint32_t SoundLevelMeter::get_update_interval() { return this->update_interval_; }
 void SoundLevelMeter::set_buffer_size(uint32_t buffer_size) { this->buffer_size_ = buffer_size; }
 uint32_t SoundLevelMeter::get_buffer_size() { return this->buffer_size_; }
-uint32_t SoundLevelMeter::get_sample_rate() { return this->i2s_->get_sample_rate(); }
-void SoundLevelMeter::set_i2s(i2s::I2SComponent *i2s) { this->i2s_ = i2s; }
+uint32_t SoundLevelMeter::get_sample_rate() { return this->source_->get_sample_rate(); }
+#ifndef USE_HOST
+void SoundLevelMeter::set_i2s(i2s::I2SComponent *i2s) { this->source_ = new I2SSampleSource(i2s); }
+#endif
+void SoundLevelMeter::set_source(SampleSource *source) { this->source_ = source; }
 void SoundLevelMeter::add_group(SensorGroup *group) { this->groups_.push_back(group); }
 void SoundLevelMeter::set_warmup_interval(uint32_t warmup_interval) { this->warmup_interval_ = warmup_interval; }
+uint32_t SoundLevelMeter::get_warmup_interval() { return this->warmup_interval_; }
 void SoundLevelMeter::set_task_stack_size(uint32_t task_stack_size) { this->task_stack_size_ = task_stack_size; }
 void SoundLevelMeter::set_task_priority(uint8_t task_priority) { this->task_priority_ = task_priority; }
 void SoundLevelMeter::set_task_core(uint8_t task_core) { this->task_core_ = task_core; }
+void SoundLevelMeter::set_reader_task_priority(uint8_t reader_task_priority) {
+  this->reader_task_priority_ = reader_task_priority;
+}
+void SoundLevelMeter::set_reader_task_core(uint8_t reader_task_core) { this->reader_task_core_ = reader_task_core; }
+void SoundLevelMeter::set_buffer_count(uint8_t buffer_count) { this->buffer_count_ = buffer_count; }
+void SoundLevelMeter::set_worker_count(uint8_t worker_count) { this->worker_count_ = worker_count; }
 void SoundLevelMeter::set_mic_sensitivity(optional<float> mic_sensitivity) { this->mic_sensitivity_ = mic_sensitivity; }
 optional<float> SoundLevelMeter::get_mic_sensitivity() { return this->mic_sensitivity_; }
 void SoundLevelMeter::set_mic_sensitivity_ref(optional<float> mic_sensitivity_ref) {
@@ -33,14 +146,91 @@ void SoundLevelMeter::set_mic_sensitivity_ref(optional<float> mic_sensitivity_re
 optional<float> SoundLevelMeter::get_mic_sensitivity_ref() { return this->mic_sensitivity_ref_; }
 void SoundLevelMeter::set_offset(optional<float> offset) { this->offset_ = offset; }
 optional<float> SoundLevelMeter::get_offset() { return this->offset_; }
+void SoundLevelMeter::set_use_psram(bool use_psram) { this->use_psram_ = use_psram; }
+void SoundLevelMeter::set_fixed_point(bool fixed_point) { this->fixed_point_ = fixed_point; }
+void SoundLevelMeter::set_publish_queue_size(uint32_t publish_queue_size) {
+  this->publish_queue_size_ = publish_queue_size;
+}
+uint32_t SoundLevelMeter::get_publish_queue_high_water_mark() { return this->publish_queue_high_water_mark_; }
+uint32_t SoundLevelMeter::get_dropped_publishes() { return this->dropped_publishes_; }
+uint32_t SoundLevelMeter::get_block_queue_size() { return this->filled_blocks_.size(); }
+uint32_t SoundLevelMeter::get_block_queue_high_water_mark() { return this->block_queue_high_water_mark_; }
+uint32_t SoundLevelMeter::get_dropped_blocks() { return this->dropped_blocks_; }
+uint32_t SoundLevelMeter::get_dropped_samples() {
+  return this->source_->get_dropped_samples() - this->source_dropped_samples_ignored_ + this->dropped_block_samples_;
+}
+void SoundLevelMeter::set_dropped_samples_sensor(sensor::Sensor *dropped_samples_sensor) {
+  this->dropped_samples_sensor_ = dropped_samples_sensor;
+}
+void SoundLevelMeter::set_sample_loss_threshold(float sample_loss_threshold) {
+  this->sample_loss_threshold_ = sample_loss_threshold;
+}
+void SoundLevelMeter::add_on_sample_loss_callback(std::function<void(float)> &&callback) {
+  this->sample_loss_callback_.add(std::move(callback));
+}
+void SoundLevelMeter::set_snapshot_duration(uint32_t snapshot_duration) {
+  this->snapshot_duration_ = snapshot_duration;
+}
+void SoundLevelMeter::set_snapshot_post_trigger(uint32_t snapshot_post_trigger) {
+  this->snapshot_post_trigger_ = snapshot_post_trigger;
+}
+SnapshotBuffer *SoundLevelMeter::get_snapshot() { return this->snapshot_.get(); }
+void SoundLevelMeter::add_on_snapshot_callback(std::function<void()> &&callback) {
+  this->snapshot_callback_.add(std::move(callback));
+}
+
+void SoundLevelMeter::set_history_size(uint32_t history_size) { this->history_size_ = history_size; }
+void SoundLevelMeter::add_history_sensor(sensor::Sensor *sensor) { this->history_sensors_.push_back(sensor); }
+void SoundLevelMeter::set_history_batch_size(uint16_t history_batch_size) {
+  this->history_batch_size_ = history_batch_size;
+}
+LevelHistory *SoundLevelMeter::get_history() { return this->history_.get(); }
+void SoundLevelMeter::add_on_history_export_callback(std::function<void(std::vector<HistoryRecord>)> &&callback) {
+  this->history_export_callback_.add(std::move(callback));
+}
+
+void SoundLevelMeter::export_history() {
+  if (this->history_ != nullptr)
+    this->history_->start_export();
+}
+
+void SoundLevelMeter::take_snapshot() {
+  if (this->snapshot_ != nullptr)
+    this->snapshot_->freeze();
+}
+
+void SoundLevelMeter::release_snapshot() {
+  if (this->snapshot_ == nullptr)
+    return;
+  this->snapshot_->release();
+  this->snapshot_reported_ = false;
+}
 
 void SoundLevelMeter::dump_config() {
   ESP_LOGCONFIG(TAG, "Sound Level Meter:");
   ESP_LOGCONFIG(TAG, "  Buffer Size: %u (samples)", this->buffer_size_);
+  ESP_LOGCONFIG(TAG, "  Buffer Count: %u", this->buffer_count_);
   ESP_LOGCONFIG(TAG, "  Warmup Interval: %lu ms", this->warmup_interval_);
   ESP_LOGCONFIG(TAG, "  Task Stack Size: %lu", this->task_stack_size_);
   ESP_LOGCONFIG(TAG, "  Task Priority: %u", this->task_priority_);
   ESP_LOGCONFIG(TAG, "  Task Core: %u", this->task_core_);
+  ESP_LOGCONFIG(TAG, "  Reader Task Priority: %u", this->reader_task_priority_);
+  ESP_LOGCONFIG(TAG, "  Reader Task Core: %u", this->reader_task_core_);
+  ESP_LOGCONFIG(TAG, "  Workers: %u (%u groups processed in parallel)", this->workers_.size(),
+                this->workers_.size() > 1 ? this->parallel_groups_.size() : 0);
+  ESP_LOGCONFIG(TAG, "  Data Type: %s", this->fixed_point_ ? "fixed point" : "float");
+  ESP_LOGCONFIG(TAG, "  Publish Queue Size: %lu", this->publish_queue_size_);
+  ESP_LOGCONFIG(TAG, "  Audio Memory: %u bytes (%u buffers in %s RAM, queues, task stacks)",
+                this->get_audio_memory_size(), this->buffer_count_ + this->scratch_.size(),
+                this->use_psram_ ? "external" : "internal");
+  if (this->snapshot_ != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Snapshot: %.1fs (%.1fs after trigger), %u bytes", this->snapshot_duration_ / 1000.f,
+                  this->snapshot_post_trigger_ / 1000.f, this->snapshot_->get_capacity() * sizeof(int16_t));
+  }
+  if (this->history_ != nullptr) {
+    ESP_LOGCONFIG(TAG, "  History: %u bytes, %u sensors, export batch size %u", this->history_->get_size(),
+                  this->history_sensors_.size(), this->history_batch_size_);
+  }
   if (this->update_interval_ == SCHEDULER_DONT_RUN) {
     ESP_LOGCONFIG(TAG, "  Update Interval: never");
   } else if (this->update_interval_ < 100) {
@@ -48,32 +238,245 @@ void SoundLevelMeter::dump_config() {
   } else {
     ESP_LOGCONFIG(TAG, "  Update Interval: %.1fs", this->update_interval_ / 1000.0f);
   }
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  ESP_LOGCONFIG(TAG, "  Profiling: enabled");
+  LOG_SENSOR("    ", "CPU Load", this->cpu_load_sensor_);
+  LOG_SENSOR("    ", "I2S Read Wait", this->i2s_read_wait_sensor_);
+  LOG_SENSOR("    ", "Publish Latency", this->publish_latency_sensor_);
+  LOG_SENSOR("    ", "Threshold Latency", this->threshold_latency_sensor_);
+#endif
   if (this->groups_.size() > 0) {
     ESP_LOGCONFIG(TAG, "  Groups:");
     for (int i = 0; i < this->groups_.size(); i++) {
       ESP_LOGCONFIG(TAG, "    Group %u:", i);
       this->groups_[i]->dump_config("      ");
     }
+    ESP_LOGCONFIG(TAG, "  Execution Plan:");
+    float cost = 0;
+    for (auto *g : this->exec_groups_) {
+      auto it = std::find(this->groups_.begin(), this->groups_.end(), g);
+      if (it != this->groups_.end())
+        ESP_LOGCONFIG(TAG, "    Group %u:", it - this->groups_.begin());
+      else
+        ESP_LOGCONFIG(TAG, "    Shared Filters:");
+      cost += g->dump_plan("      ", this->buffer_size_);
+    }
+    ESP_LOGCONFIG(TAG, "  Estimated Cost: %.0f MAC per block, %.1f MMAC/s", cost,
+                  cost / this->buffer_size_ * this->get_sample_rate() / 1e6f);
   }
 }
 
 void SoundLevelMeter::setup() {
-  xTaskCreatePinnedToCore(SoundLevelMeter::task, "sound_level_meter", this->task_stack_size_, this,
-                          this->task_priority_, nullptr, this->task_core_);
+  this->exec_groups_ = SensorGroup::share_filters(this->groups_);
+  for (auto *g : this->groups_) {
+    g->set_sample_rate(this->get_sample_rate());
+    g->update_needed();
+  }
+  for (auto *g : this->exec_groups_) {
+    g->build_plan();
+    g->update_state(true, true);
+  }
+
+  this->parallel_groups_ = this->exec_groups_;
+  while (this->parallel_groups_.size() == 1 && !this->parallel_groups_[0]->get_exec_groups().empty() &&
+         !this->parallel_groups_[0]->has_filter_bank()) {
+    this->serial_groups_.push_back(this->parallel_groups_[0]);
+    this->parallel_groups_ = this->parallel_groups_[0]->get_exec_groups();
+  }
+  // there is nothing to run in parallel if there are less groups than workers
+  size_t worker_count = std::max<size_t>(1, std::min<size_t>(this->worker_count_, this->parallel_groups_.size()));
+  this->serial_depth_ = std::count_if(this->serial_groups_.begin(), this->serial_groups_.end(),
+                                      [](SensorGroup *g) { return g->has_filters(); });
+  for (auto *g : this->parallel_groups_)
+    this->scratch_depth_ = std::max(this->scratch_depth_, g->get_scratch_depth());
+  size_t depth = this->serial_depth_ + this->scratch_depth_ * worker_count;
+
+  RAMAllocator<float> allocator(this->use_psram_ ? RAMAllocator<float>::ALLOC_EXTERNAL
+                                                 : RAMAllocator<float>::ALLOC_INTERNAL);
+  this->buffers_.resize(this->buffer_count_);
+  for (size_t i = 0; i < this->buffer_count_; i++)
+    this->buffers_[i] = allocator.allocate(this->buffer_size_);
+  this->scratch_.resize(depth);
+  this->scratch_fixed_.resize(depth);
+  for (size_t i = 0; i < depth; i++) {
+    this->scratch_[i] = allocator.allocate(this->buffer_size_);
+    this->scratch_fixed_[i] = reinterpret_cast<int32_t *>(this->scratch_[i]);
+  }
+  if (std::any_of(this->buffers_.begin(), this->buffers_.end(), [](void *b) { return b == nullptr; }) ||
+      std::any_of(this->scratch_.begin(), this->scratch_.end(), [](float *b) { return b == nullptr; })) {
+    ESP_LOGE(TAG, "Failed to allocate %u audio buffers of %u samples", this->buffer_count_ + depth,
+             this->buffer_size_);
+    this->mark_failed();
+    return;
+  }
+  this->publish_queues_.reset(new SPSCQueue<PublishRecord>[worker_count]);
+  this->threshold_queues_.reset(new SPSCQueue<ThresholdRecord>[worker_count]);
+  for (size_t i = 0; i < worker_count; i++) {
+    this->publish_queues_[i].init(this->publish_queue_size_);
+    this->threshold_queues_[i].init(THRESHOLD_QUEUE_SIZE);
+  }
+  if (this->snapshot_duration_ > 0) {
+    // snapshot is optional, so the meter keeps working without it
+    auto *snapshot = new SnapshotBuffer();
+    float samples_per_ms = this->get_sample_rate() / 1000.f;
+    if (snapshot->init(this->get_sample_rate(), this->snapshot_duration_ * samples_per_ms,
+                       this->snapshot_post_trigger_ * samples_per_ms)) {
+      this->snapshot_.reset(snapshot);
+    } else {
+      ESP_LOGE(TAG, "Failed to allocate snapshot buffer of %.1fs", this->snapshot_duration_ / 1000.f);
+      delete snapshot;
+    }
+  }
+  if (this->history_size_ > 0) {
+    auto *history = new LevelHistory();
+    if (history->init(this->history_size_, this->history_sensors_)) {
+      this->history_.reset(history);
+      this->history_batch_.reserve(this->history_batch_size_);
+    } else {
+      ESP_LOGE(TAG, "Failed to allocate history buffer of %lu bytes", this->history_size_);
+      delete history;
+    }
+  }
+  // one extra slot for an empty block signalling turn off
+  this->filled_blocks_.init(this->buffer_count_ + 1);
+  this->free_buffers_.init(this->buffer_count_);
+  for (auto *b : this->buffers_)
+    this->free_buffers_.push(b);
+
+  this->workers_.resize(worker_count);
+  for (size_t i = 0; i < worker_count; i++) {
+    this->workers_[i] = {this, uint8_t(i), nullptr, {}};
+    this->workers_[i].groups.reserve(this->parallel_groups_.size());
+  }
+  this->group_cost_.assign(this->parallel_groups_.size(), 0.f);
+  this->balance_order_.resize(this->parallel_groups_.size());
+  this->balance_load_.resize(worker_count);
+  this->balance_workers();
+  // worker tasks are also used on host, where process() is called directly
+  for (size_t i = 1; i < worker_count; i++) {
+    xTaskCreatePinnedToCore(SoundLevelMeter::worker_task, "sound_level_meter_worker", this->task_stack_size_,
+                            &this->workers_[i], this->task_priority_, &this->workers_[i].task,
+                            (this->task_core_ + i) % 2);
+  }
+
+#ifndef USE_HOST
+  // DSP task is created first, so that its handle is known when the reader starts
+  xTaskCreatePinnedToCore(SoundLevelMeter::dsp_task, "sound_level_meter", this->task_stack_size_, this,
+                          this->task_priority_, &this->dsp_task_handle_, this->task_core_);
+  xTaskCreatePinnedToCore(SoundLevelMeter::reader_task, "sound_level_meter_reader", READER_TASK_STACK_SIZE, this,
+                          this->reader_task_priority_, nullptr, this->reader_task_core_);
+#endif
 }
 
 void SoundLevelMeter::loop() {
-  std::lock_guard<std::mutex> lock(this->defer_mutex_);
-  if (!this->defer_queue_.empty()) {
-    auto &f = this->defer_queue_.front();
-    f();
-    this->defer_queue_.pop();
+  // threshold crossings are few, so they are always drained completely and before regular values
+  ThresholdRecord t;
+  for (size_t i = 0; i < this->workers_.size(); i++) {
+    while (this->threshold_queues_[i].pop(t)) {
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+      this->max_threshold_latency_ =
+          std::max(this->max_threshold_latency_, uint32_t(esp_timer_get_time()) - t.detected_at);
+      this->threshold_latency_count_++;
+#endif
+      t.sensor->publish_threshold(t.level);
+    }
+  }
+
+  // only drain what is already there, so that a busy audio task can't keep the main loop here forever
+  PublishRecord r;
+  for (size_t i = 0; i < this->workers_.size(); i++) {
+    auto &queue = this->publish_queues_[i];
+    for (size_t n = queue.size(); n > 0 && queue.pop(r); n--) {
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+      this->max_publish_latency_ =
+          std::max(this->max_publish_latency_, uint32_t(esp_timer_get_time()) - r.enqueued_at);
+#endif
+      r.sensor->publish_state(r.state);
+    }
+  }
+
+  // consumers of internal sensors (history, other sensor platforms) could subscribe after setup() of
+  // this component, so groups that nothing would read are looked for on every loop
+  bool needed_changed = false;
+  for (auto *g : this->groups_)
+    needed_changed |= g->update_needed();
+  if (needed_changed)
+    this->group_states_changed_ = true;
+
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  if (millis() - this->publish_latency_start_ >= this->update_interval_) {
+    if (this->publish_latency_sensor_ != nullptr)
+      this->publish_latency_sensor_->publish_state(this->max_publish_latency_ / 1000.f);
+    // NAN if there was no threshold crossing during update interval
+    if (this->threshold_latency_sensor_ != nullptr)
+      this->threshold_latency_sensor_->publish_state(
+          this->threshold_latency_count_ > 0 ? this->max_threshold_latency_ / 1000.f : NAN);
+    this->max_publish_latency_ = 0;
+    this->max_threshold_latency_ = 0;
+    this->threshold_latency_count_ = 0;
+    this->publish_latency_start_ = millis();
+  }
+#endif
+
+  uint32_t dropped = this->dropped_publishes_;
+  if (dropped != this->reported_dropped_publishes_) {
+    ESP_LOGW(TAG, "Publish queue is full, %lu values dropped so far (queue size: %lu)", dropped,
+             this->publish_queue_size_);
+    this->reported_dropped_publishes_ = dropped;
+  }
+
+  dropped = this->dropped_blocks_;
+  if (dropped != this->reported_dropped_blocks_) {
+    ESP_LOGW(TAG, "Audio processing can't keep up, %lu blocks dropped so far (buffer count: %u)", dropped,
+             this->buffer_count_);
+    this->reported_dropped_blocks_ = dropped;
+  }
+
+  this->check_sample_loss();
+
+  if (this->snapshot_ != nullptr && !this->snapshot_reported_ && this->snapshot_->is_frozen()) {
+    this->snapshot_reported_ = true;
+    ESP_LOGD(TAG, "Snapshot is ready: %u bytes", this->snapshot_->get_wav_size());
+    this->snapshot_callback_.call();
+  }
+
+  // a batch per loop, so that a long backlog doesn't block the main loop
+  if (this->history_ != nullptr && this->history_->is_exporting()) {
+    this->history_->export_batch(this->history_batch_, this->history_batch_size_, millis());
+    if (!this->history_batch_.empty())
+      this->history_export_callback_.call(this->history_batch_);
+    if (!this->history_->is_exporting() && this->history_->get_lost_records() != this->reported_lost_records_) {
+      this->reported_lost_records_ = this->history_->get_lost_records();
+      ESP_LOGW(TAG, "History buffer is full, %lu records overwritten before export so far",
+               this->reported_lost_records_);
+    }
+  }
+}
+
+void SoundLevelMeter::check_sample_loss() {
+  // the check is driven by processed samples rather than time, so that it works the same in offline replay
+  uint32_t processed = this->processed_samples_.load(std::memory_order_relaxed);
+  uint32_t interval = processed - this->loss_check_processed_samples_;
+  if (interval < this->get_sample_rate() * (this->update_interval_ / 1000.f))
+    return;
+  uint32_t total = this->get_dropped_samples();
+  uint32_t dropped = total - this->loss_check_dropped_samples_;
+  this->loss_check_processed_samples_ = processed;
+  this->loss_check_dropped_samples_ = total;
+
+  if (this->dropped_samples_sensor_ != nullptr)
+    this->dropped_samples_sensor_->publish_state(total);
+  float loss = 100.f * dropped / (interval + dropped);
+  if (dropped > 0 && loss > this->sample_loss_threshold_) {
+    ESP_LOGW(TAG, "%lu samples (%.2f%%) lost during the last update interval, measurements are biased", dropped,
+             loss);
+    this->sample_loss_callback_.call(loss);
   }
 }
 
 void SoundLevelMeter::turn_on() {
   std::lock_guard<std::mutex> lock(this->on_mutex_);
-  this->reset();
+  this->reset_pending_ = true;
   this->is_on_ = true;
   this->on_cv_.notify_one();
   ESP_LOGD(TAG, "Turned on");
@@ -81,7 +484,7 @@ void SoundLevelMeter::turn_on() {
 
 void SoundLevelMeter::turn_off() {
   std::lock_guard<std::mutex> lock(this->on_mutex_);
-  this->reset();
+  this->reset_pending_ = true;
   this->is_on_ = false;
   this->on_cv_.notify_one();
   ESP_LOGD(TAG, "Turned off");
@@ -96,276 +499,2269 @@ void SoundLevelMeter::toggle() {
 
 bool SoundLevelMeter::is_on() { return this->is_on_; }
 
-void SoundLevelMeter::task(void *param) {
+size_t SoundLevelMeter::get_audio_memory_size() {
+  return (this->buffer_count_ + this->scratch_.size()) * this->buffer_size_ * sizeof(float) +
+         this->workers_.size() * ((this->publish_queue_size_ + 1) * sizeof(PublishRecord) +
+                                  (THRESHOLD_QUEUE_SIZE + 1) * sizeof(ThresholdRecord) + this->task_stack_size_) +
+         (this->buffer_count_ + 2) * sizeof(AudioBlock) + (this->buffer_count_ + 1) * sizeof(void *) +
+         READER_TASK_STACK_SIZE;
+}
+
+bool SoundLevelMeter::read_block(void *buffer, size_t *samples_read) {
+  if (this->fixed_point_)
+    return this->source_->read_samples(static_cast<int32_t *>(buffer), this->buffer_size_, samples_read);
+  return this->source_->read_samples(static_cast<float *>(buffer), this->buffer_size_, samples_read);
+}
+
+void SoundLevelMeter::reader_task(void *param) {
   SoundLevelMeter *this_ = reinterpret_cast<SoundLevelMeter *>(param);
-  std::vector<float> buffer(this_->buffer_size_);
+  void *buffer, *next;
+  // setup() fills the pool before starting this task, so this only waits if buffers are still with the DSP task
+  while (!this_->free_buffers_.pop(buffer))
+    vTaskDelay(1);
+  size_t samples_read;
 
   auto warmup_start = millis();
   while (millis() - warmup_start < this_->warmup_interval_)
-    this_->i2s_->read_samples(buffer);
+    this_->read_block(buffer, &samples_read);
+  uint32_t last_source_dropped = this_->source_->get_dropped_samples();
+  this_->source_dropped_samples_ignored_ = last_source_dropped;
 
-  uint32_t process_time = 0, process_count = 0;
-  uint64_t process_start;
+  bool reset = false;
   while (1) {
     {
       std::unique_lock<std::mutex> lock(this_->on_mutex_);
-      this_->on_cv_.wait(lock, [this_] { return this_->is_on_; });
+      this_->on_cv_.wait(lock, [this_] { return this_->is_on_ || this_->reset_pending_; });
+      if (this_->reset_pending_) {
+        reset = true;
+        this_->reset_pending_ = false;
+      }
+      if (!this_->is_on_) {
+        // turned off: pass an empty block, so that DSP task resets sensors right away,
+        // if the queue is full the reset is carried by the first block after turning on
+        if (this_->filled_blocks_.push({nullptr, 0, true})) {
+          reset = false;
+          xTaskNotifyGive(this_->dsp_task_handle_);
+        }
+        continue;
+      }
+    }
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+    auto read_start = esp_timer_get_time();
+    bool read = this_->read_block(buffer, &samples_read);
+    this_->read_wait_time_.fetch_add(esp_timer_get_time() - read_start, std::memory_order_relaxed);
+    if (!read)
+      continue;
+#else
+    if (!this_->read_block(buffer, &samples_read))
+      continue;
+#endif
+    // DMA buffers keep overflowing while turned off, those samples were not supposed to be processed,
+    // so what the source has dropped since the previous read is ignored for the first read after reset
+    uint32_t source_dropped = this_->source_->get_dropped_samples();
+    if (reset)
+      this_->source_dropped_samples_ignored_ += source_dropped - last_source_dropped;
+    last_source_dropped = source_dropped;
+    // recorded here rather than by the DSP task, so that processing doesn't spend any time on it.
+    // Audio before turning off and after turning on is not continuous, so it starts over
+    if (this_->snapshot_ != nullptr) {
+      if (reset)
+        this_->snapshot_->clear();
+      if (this_->fixed_point_)
+        this_->snapshot_->write(static_cast<int32_t *>(buffer), samples_read);
+      else
+        this_->snapshot_->write(static_cast<float *>(buffer), samples_read);
+    }
+
+    // reader always keeps one buffer for itself, if there is no free one to swap with,
+    // DSP task is behind and the block is dropped, so that I2S DMA never overflows
+    if (!this_->free_buffers_.pop(next)) {
+      this_->dropped_blocks_.fetch_add(1, std::memory_order_relaxed);
+      this_->dropped_block_samples_.fetch_add(samples_read, std::memory_order_relaxed);
+      continue;
     }
-    if (this_->i2s_->read_samples(buffer)) {
+    this_->filled_blocks_.push({buffer, samples_read, reset});
+    reset = false;
+    buffer = next;
+    uint32_t size = this_->filled_blocks_.size();
+    if (size > this_->block_queue_high_water_mark_.load(std::memory_order_relaxed))
+      this_->block_queue_high_water_mark_.store(size, std::memory_order_relaxed);
+    xTaskNotifyGive(this_->dsp_task_handle_);
+  }
+}
+
+void SoundLevelMeter::dsp_task(void *param) {
+  SoundLevelMeter *this_ = reinterpret_cast<SoundLevelMeter *>(param);
+  AudioBlock block;
+
+  uint32_t process_time = 0, process_count = 0;
+  uint64_t process_start;
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (this_->filled_blocks_.pop(block)) {
       process_start = esp_timer_get_time();
 
-      for (auto *g : this_->groups_)
-        g->process(buffer);
+      if (block.reset)
+        this_->reset();
+      if (block.data == nullptr)
+        continue;
+      if (this_->fixed_point_)
+        this_->process(static_cast<int32_t *>(block.data), block.len);
+      else
+        this_->process(static_cast<float *>(block.data), block.len);
+      this_->free_buffers_.push(block.data);
 
       process_time += esp_timer_get_time() - process_start;
-      process_count += buffer.size();
+      process_count += block.len;
 
       auto sr = this_->get_sample_rate();
       if (process_count >= sr * (this_->update_interval_ / 1000.f)) {
         auto t = uint32_t(float(process_time) / process_count * (sr / 1000.f));
-        ESP_LOGD(TAG, "Processing time per 1s of audio data (%lu samples): %lu ms", sr, t);
+        ESP_LOGD(TAG, "Processing time per 1s of audio data (%lu samples): %lu ms, block queue high water mark: %lu",
+                 sr, t, this_->get_block_queue_high_water_mark());
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+        float audio_time = process_count * (1e6f / sr);
+        uint32_t read_wait = this_->read_wait_time_.exchange(0, std::memory_order_relaxed);
+        if (this_->cpu_load_sensor_ != nullptr)
+          this_->enqueue_publish(0, this_->cpu_load_sensor_, process_time / audio_time * 100);
+        if (this_->i2s_read_wait_sensor_ != nullptr)
+          this_->enqueue_publish(0, this_->i2s_read_wait_sensor_, read_wait / audio_time * 100);
+#endif
         process_time = process_count = 0;
       }
     }
   }
 }
 
-void SoundLevelMeter::defer(std::function<void()> &&f) {
-  std::lock_guard<std::mutex> lock(this->defer_mutex_);
-  this->defer_queue_.push(std::move(f));
+void SoundLevelMeter::worker_task(void *param) {
+  Worker *worker = static_cast<Worker *>(param);
+  SoundLevelMeter *this_ = worker->parent;
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (this_->job_fixed_point_)
+      this_->process_worker_(worker->index, static_cast<const int32_t *>(this_->job_data_), this_->job_len_);
+    else
+      this_->process_worker_(worker->index, static_cast<const float *>(this_->job_data_), this_->job_len_);
+    // the next block could be set up as soon as the counter drops to zero, so read the handle first
+    TaskHandle_t join_task = this_->join_task_;
+    if (this_->pending_workers_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      xTaskNotifyGive(join_task);
+  }
 }
 
-void SoundLevelMeter::reset() {
-  for (auto *g : this->groups_)
-    g->reset();
+template<> float *const *SoundLevelMeter::get_scratch<float>(size_t offset) { return this->scratch_.data() + offset; }
+template<> int32_t *const *SoundLevelMeter::get_scratch<int32_t>(size_t offset) {
+  return this->scratch_fixed_.data() + offset;
 }
 
-/* SensorGroup */
+void SoundLevelMeter::process(float *data, size_t len) { this->process_(data, len); }
+void SoundLevelMeter::process(int32_t *data, size_t len) { this->process_(data, len); }
 
-void SensorGroup::set_parent(SoundLevelMeter *parent) { this->parent_ = parent; }
-void SensorGroup::add_sensor(SoundLevelMeterSensor *sensor) { this->sensors_.push_back(sensor); }
-void SensorGroup::add_group(SensorGroup *group) { this->groups_.push_back(group); }
-void SensorGroup::add_filter(Filter *filter) { this->filters_.push_back(filter); }
+template<typename T> void SoundLevelMeter::process_(T *data, size_t len) {
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  auto start = esp_timer_get_time();
+#endif
+  if (this->group_states_changed_.exchange(false)) {
+    for (auto *g : this->exec_groups_)
+      g->update_state(true, false);
+  }
+  if (this->workers_.size() <= 1) {
+    for (auto *g : this->exec_groups_)
+      g->process(data, len, this->get_scratch<T>(0));
+  } else {
+    this->process_parallel_(data, len);
+  }
+  this->processed_samples_.fetch_add(len, std::memory_order_relaxed);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  this->profile_time_ += esp_timer_get_time() - start;
+  this->profile_samples_ += len;
+  if (this->profile_dump_pending_.exchange(false))
+    this->log_profile();
+#endif
+}
 
-void SensorGroup::dump_config(const char *prefix) {
-  ESP_LOGCONFIG(TAG, "%sSensors:", prefix);
-  for (auto *s : this->sensors_)
-    LOG_SENSOR((std::string(prefix) + "  ").c_str(), "Sound Pressure Level", s);
+template<typename T> void SoundLevelMeter::process_parallel_(T *data, size_t len) {
+  // workers are idle between blocks, so groups could be safely moved between them here
+  if (++this->blocks_since_balance_ >= BALANCE_INTERVAL_BLOCKS) {
+    this->balance_workers();
+    this->blocks_since_balance_ = 0;
+  }
+  const T *input = data;
+  T *const *scratch = this->get_scratch<T>(0);
+  for (auto *g : this->serial_groups_) {
+    // the rest of serial groups and all parallel ones are nested in this one
+    if (!g->is_active())
+      return;
+    input = g->process_own(input, len, g->has_filters() ? *scratch++ : nullptr);
+  }
 
-  if (this->groups_.size() > 0) {
-    ESP_LOGCONFIG(TAG, "%sGroups:", prefix);
-    for (int i = 0; i < this->groups_.size(); i++) {
-      ESP_LOGCONFIG(TAG, "%s  Group %u:", prefix, i);
-      this->groups_[i]->dump_config((std::string(prefix) + "    ").c_str());
-    }
+  this->job_data_ = input;
+  this->job_len_ = len;
+  this->job_fixed_point_ = std::is_same<T, int32_t>::value;
+  this->join_task_ = xTaskGetCurrentTaskHandle();
+  this->pending_workers_.store(this->workers_.size() - 1, std::memory_order_release);
+  for (size_t i = 1; i < this->workers_.size(); i++)
+    xTaskNotifyGive(this->workers_[i].task);
+
+  this->process_worker_(0, input, len);
+
+  // DSP task is also notified by the reader task, so the counter decides when all workers are done
+  while (this->pending_workers_.load(std::memory_order_acquire) > 0)
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+template<typename T> void SoundLevelMeter::process_worker_(size_t worker, const T *data, size_t len) {
+  T *const *scratch = this->get_scratch<T>(this->serial_depth_ + worker * this->scratch_depth_);
+  for (auto i : this->workers_[worker].groups) {
+    auto start = esp_timer_get_time();
+    this->parallel_groups_[i]->process(data, len, scratch);
+    float t = esp_timer_get_time() - start;
+    this->group_cost_[i] += (t - this->group_cost_[i]) * GROUP_COST_SMOOTHING;
   }
 }
 
-void SensorGroup::process(std::vector<float> &buffer) {
-  std::vector<float> &&data = this->filters_.size() > 0 ? std::vector<float>(buffer) : buffer;
-  if (this->filters_.size() > 0)
-    for (auto f : this->filters_)
-      f->process(data);
+// greedy longest-processing-time-first scheduling: most expensive groups go first,
+// each one to the currently least loaded worker
+void SoundLevelMeter::balance_workers() {
+  for (size_t i = 0; i < this->balance_order_.size(); i++)
+    this->balance_order_[i] = i;
+  std::stable_sort(this->balance_order_.begin(), this->balance_order_.end(),
+                   [this](size_t a, size_t b) { return this->group_cost_[a] > this->group_cost_[b]; });
+  std::fill(this->balance_load_.begin(), this->balance_load_.end(), 0.f);
+  for (auto &w : this->workers_)
+    w.groups.clear();
+  for (auto i : this->balance_order_) {
+    size_t w = std::min_element(this->balance_load_.begin(), this->balance_load_.end()) - this->balance_load_.begin();
+    this->workers_[w].groups.push_back(i);
+    this->balance_load_[w] += this->group_cost_[i];
+    this->parallel_groups_[i]->set_worker(w);
+  }
+}
 
-  for (auto s : this->sensors_)
-    s->process(data);
+void SoundLevelMeter::enqueue_publish(uint8_t worker, sensor::Sensor *sensor, float state) {
+  // never block the audio task, if main loop can't keep up the value is lost
+  auto &queue = this->publish_queues_[worker];
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  if (!queue.push({sensor, state, uint32_t(esp_timer_get_time())})) {
+#else
+  if (!queue.push({sensor, state})) {
+#endif
+    this->dropped_publishes_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  uint32_t size = queue.size();
+  // queues of different workers are filled concurrently
+  auto &high_water_mark = this->publish_queue_high_water_mark_;
+  uint32_t current = high_water_mark.load(std::memory_order_relaxed);
+  while (size > current && !high_water_mark.compare_exchange_weak(current, size, std::memory_order_relaxed)) {
+  }
+}
 
-  for (auto g : this->groups_)
-    g->process(data);
+void SoundLevelMeter::enqueue_threshold(uint8_t worker, SoundLevelMeterSensor *sensor, float level) {
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  if (!this->threshold_queues_[worker].push({sensor, level, uint32_t(esp_timer_get_time())}))
+#else
+  if (!this->threshold_queues_[worker].push({sensor, level}))
+#endif
+    this->dropped_publishes_.fetch_add(1, std::memory_order_relaxed);
 }
 
-void SensorGroup::reset() {
-  for (auto f : this->filters_)
-    f->reset();
-  for (auto s : this->sensors_)
-    s->reset();
-  for (auto g : this->groups_)
+void SoundLevelMeter::reset() {
+  for (auto *g : this->exec_groups_)
     g->reset();
 }
 
-/* SoundLevelMeterSensor */
-
-void SoundLevelMeterSensor::set_parent(SoundLevelMeter *parent) {
-  this->parent_ = parent;
-  this->update_samples_ = parent->get_sample_rate() * (parent->get_update_interval() / 1000.f);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+void SoundLevelMeter::set_cpu_load_sensor(sensor::Sensor *cpu_load_sensor) {
+  this->cpu_load_sensor_ = cpu_load_sensor;
+}
+void SoundLevelMeter::set_i2s_read_wait_sensor(sensor::Sensor *i2s_read_wait_sensor) {
+  this->i2s_read_wait_sensor_ = i2s_read_wait_sensor;
+}
+void SoundLevelMeter::set_publish_latency_sensor(sensor::Sensor *publish_latency_sensor) {
+  this->publish_latency_sensor_ = publish_latency_sensor;
+}
+void SoundLevelMeter::set_threshold_latency_sensor(sensor::Sensor *threshold_latency_sensor) {
+  this->threshold_latency_sensor_ = threshold_latency_sensor;
 }
 
-void SoundLevelMeterSensor::set_update_interval(uint32_t update_interval) {
-  this->update_samples_ = this->parent_->get_sample_rate() * (update_interval / 1000.f);
+void SoundLevelMeter::dump_profile() {
+#ifdef USE_HOST
+  // on host process() is called by the caller, so there is no concurrent processing
+  this->log_profile();
+#else
+  this->profile_dump_pending_ = true;
+#endif
 }
 
-void SoundLevelMeterSensor::defer_publish_state(float state) {
-  this->parent_->defer([this, state]() { this->publish_state(state); });
+void SoundLevelMeter::log_profile() {
+  if (this->profile_samples_ == 0) {
+    ESP_LOGI(TAG, "Profile: no audio processed yet");
+    return;
+  }
+  float audio_time = this->profile_samples_ * (1e6f / this->get_sample_rate());
+  // with several workers the sum of groups could be greater than the wall time
+  ESP_LOGI(TAG, "Profile of %.1fs of audio, %% of real time:", audio_time / 1e6f);
+  ESP_LOGI(TAG, "  Total: %.2f%%", this->profile_time_ / audio_time * 100);
+  for (size_t i = 0; i < this->groups_.size(); i++) {
+    ESP_LOGI(TAG, "  Group %u: %.2f%%", i, this->groups_[i]->get_profile_time() / audio_time * 100);
+    this->groups_[i]->dump_profile("    ", audio_time);
+  }
+  uint64_t shared_time = SensorGroup::get_shared_profile_time(this->exec_groups_);
+  if (shared_time > 0)
+    ESP_LOGI(TAG, "  Shared Filters: %.2f%%", shared_time / audio_time * 100);
+  for (auto *g : this->exec_groups_)
+    g->reset_profile();
+  this->profile_time_ = this->profile_samples_ = 0;
 }
+#else
+void SoundLevelMeter::dump_profile() { ESP_LOGW(TAG, "Profiling is not enabled"); }
+#endif
 
-float SoundLevelMeterSensor::adjust_dB(float dB, bool is_rms) {
-  // see: https://dsp.stackexchange.com/a/50947/65262
-  if (is_rms)
-    dB += DBFS_OFFSET;
+/* SnapshotBuffer */
 
-  // see: https://invensense.tdk.com/wp-content/uploads/2015/02/AN-1112-v1.1.pdf
-  // dBSPL = dBFS + mic_sensitivity_ref - mic_sensitivity
-  // e.g. dBSPL = dBFS + 94 - (-26) = dBFS + 120
-  if (this->parent_->get_mic_sensitivity().has_value() && this->parent_->get_mic_sensitivity_ref().has_value())
-    dB += *this->parent_->get_mic_sensitivity_ref() - *this->parent_->get_mic_sensitivity();
+static const size_t WAV_HEADER_SIZE = 44;
 
-  if (this->parent_->get_offset().has_value())
-    dB += *this->parent_->get_offset();
+static inline void to_int16(const float *data, int16_t *out, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    out[i] = std::min(std::max(data[i] * 32768.f, -32768.f), 32767.f);
+}
 
-  return dB;
+static inline void to_int16(const int32_t *data, int16_t *out, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    out[i] = std::min(std::max(data[i] >> (FIXED_POINT_FRAC_BITS - 15), -32768), 32767);
 }
 
-/* SoundLevelMeterSensorEq */
+bool SnapshotBuffer::init(uint32_t sample_rate, size_t capacity, size_t post_trigger) {
+  // external RAM if available, otherwise internal
+  RAMAllocator<int16_t> allocator;
+  this->samples_ = allocator.allocate(capacity);
+  this->sample_rate_ = sample_rate;
+  this->capacity_ = capacity;
+  this->post_trigger_ = std::min(post_trigger, capacity);
+  return this->samples_ != nullptr;
+}
 
-void SoundLevelMeterSensorEq::process(std::vector<float> &buffer) {
-  // as adding small floating point numbers with large ones might lead
-  // to precision loss, we first accumulate local sum for entire buffer
-  // and only in the end add it to global sum which could become quite large
-  // for large accumulating periods (like 1 hour), therefore global sum (this->sum_)
-  // is of type double
-  float local_sum = 0;
-  for (int i = 0; i < buffer.size(); i++) {
-    local_sum += buffer[i] * buffer[i];
-    this->count_++;
-    if (this->count_ == this->update_samples_) {
-      float dB = 10 * log10((sum_ + local_sum) / count_);
-      dB = this->adjust_dB(dB);
-      this->defer_publish_state(dB);
-      this->sum_ = 0;
-      this->count_ = 0;
-      local_sum = 0;
-    }
+size_t SnapshotBuffer::get_capacity() { return this->capacity_; }
+
+template<typename T> void SnapshotBuffer::write(const T *data, size_t len) {
+  if (this->frozen_.load(std::memory_order_acquire))
+    return;
+  // only the last capacity samples of a long block would be kept anyway
+  size_t n = std::min(len, this->capacity_);
+  data += len - n;
+  size_t first = std::min(n, this->capacity_ - this->head_);
+  to_int16(data, this->samples_ + this->head_, first);
+  to_int16(data + first, this->samples_, n - first);
+  this->head_ = (this->head_ + n) % this->capacity_;
+  this->count_ = std::min(this->count_ + n, this->capacity_);
+
+  if (!this->freeze_pending_.load(std::memory_order_acquire))
+    return;
+  if (!this->post_trigger_started_) {
+    this->post_trigger_started_ = true;
+    this->post_trigger_left_ = this->post_trigger_;
+  }
+  this->post_trigger_left_ -= std::min(this->post_trigger_left_, len);
+  if (this->post_trigger_left_ == 0) {
+    this->post_trigger_started_ = false;
+    this->freeze_pending_.store(false, std::memory_order_relaxed);
+    this->frozen_.store(true, std::memory_order_release);
   }
-  this->sum_ += local_sum;
 }
 
-void SoundLevelMeterSensorEq::reset() {
-  this->sum_ = 0.;
+template void SnapshotBuffer::write(const float *data, size_t len);
+template void SnapshotBuffer::write(const int32_t *data, size_t len);
+
+void SnapshotBuffer::clear() {
+  if (this->frozen_.load(std::memory_order_acquire))
+    return;
+  this->head_ = 0;
   this->count_ = 0;
-  this->defer_publish_state(NAN);
 }
 
-/* SoundLevelMeterSensorMax */
+void SnapshotBuffer::freeze() {
+  // the first request wins, until the snapshot is released
+  if (!this->frozen_.load(std::memory_order_acquire))
+    this->freeze_pending_.store(true, std::memory_order_release);
+}
+
+bool SnapshotBuffer::is_frozen() { return this->frozen_.load(std::memory_order_acquire); }
 
-void SoundLevelMeterSensorMax::set_window_size(uint32_t window_size) {
-  this->window_samples_ = this->parent_->get_sample_rate() * (window_size / 1000.f);
+void SnapshotBuffer::release() {
+  if (!this->frozen_.load(std::memory_order_acquire))
+    return;
+  // the reader task doesn't touch the buffer while frozen, recording starts over
+  this->freeze_pending_.store(false, std::memory_order_relaxed);
+  this->head_ = 0;
+  this->count_ = 0;
+  this->frozen_.store(false, std::memory_order_release);
 }
 
-void SoundLevelMeterSensorMax::process(std::vector<float> &buffer) {
-  for (int i = 0; i < buffer.size(); i++) {
-    this->sum_ += buffer[i] * buffer[i];
-    this->count_sum_++;
-    if (this->count_sum_ == this->window_samples_) {
-      this->max_ = std::max(this->max_, this->sum_ / this->count_sum_);
-      this->sum_ = 0.f;
-      this->count_sum_ = 0;
-    }
-    this->count_max_++;
-    if (this->count_max_ == this->update_samples_) {
-      float dB = 10 * log10(this->max_);
-      dB = this->adjust_dB(dB);
-      this->defer_publish_state(dB);
-      this->max_ = std::numeric_limits<float>::min();
-      this->count_max_ = 0;
-    }
+size_t SnapshotBuffer::get_wav_size() { return WAV_HEADER_SIZE + this->count_ * sizeof(int16_t); }
+
+size_t SnapshotBuffer::read_wav(size_t offset, uint8_t *data, size_t len) {
+  if (!this->is_frozen())
+    return 0;
+  size_t size = this->get_wav_size();
+  if (offset >= size)
+    return 0;
+  len = std::min(len, size - offset);
+  size_t done = 0;
+  if (offset < WAV_HEADER_SIZE) {
+    uint32_t data_size = this->count_ * sizeof(int16_t);
+    uint8_t header[WAV_HEADER_SIZE];
+    auto put = [&header](size_t pos, uint32_t value, size_t bytes) {
+      for (size_t i = 0; i < bytes; i++)
+        header[pos + i] = value >> (8 * i);
+    };
+    memcpy(header, "RIFF", 4);
+    put(4, 36 + data_size, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    // fmt chunk: size, PCM, mono, sample rate, byte rate, block align, bits per sample
+    put(16, 16, 4);
+    put(20, 1, 2);
+    put(22, 1, 2);
+    put(24, this->sample_rate_, 4);
+    put(28, this->sample_rate_ * sizeof(int16_t), 4);
+    put(32, sizeof(int16_t), 2);
+    put(34, 16, 2);
+    memcpy(header + 36, "data", 4);
+    put(40, data_size, 4);
+    done = std::min(len, WAV_HEADER_SIZE - offset);
+    memcpy(data, header + offset, done);
   }
+  // samples are little endian both on ESP32 and on host, so they are copied as bytes,
+  // the oldest one is count_ samples before head_
+  const uint8_t *ring = reinterpret_cast<const uint8_t *>(this->samples_);
+  size_t ring_size = this->capacity_ * sizeof(int16_t);
+  size_t start = (this->head_ + this->capacity_ - this->count_) % this->capacity_ * sizeof(int16_t);
+  while (done < len) {
+    size_t pos = (start + offset + done - WAV_HEADER_SIZE) % ring_size;
+    size_t n = std::min(len - done, ring_size - pos);
+    memcpy(data + done, ring + pos, n);
+    done += n;
+  }
+  return done;
 }
 
-void SoundLevelMeterSensorMax::reset() {
-  this->sum_ = 0.f;
-  this->max_ = std::numeric_limits<float>::min();
-  this->count_max_ = 0;
-  this->count_sum_ = 0;
-  this->defer_publish_state(NAN);
+#ifdef USE_SOUND_LEVEL_METER_TAP
+/* PcmTap */
+
+void PcmTap::set_port(uint16_t port) { this->port_ = port; }
+
+void PcmTap::set_buffer_count(uint8_t buffer_count) { this->buffer_count_ = buffer_count; }
+
+bool PcmTap::setup(float sample_rate, size_t block_size) {
+  this->sample_rate_ = std::lround(sample_rate);
+  this->block_size_ = block_size;
+  RAMAllocator<float> allocator;
+  this->buffers_.resize(this->buffer_count_);
+  for (size_t i = 0; i < this->buffer_count_; i++) {
+    this->buffers_[i] = allocator.allocate(block_size);
+    if (this->buffers_[i] == nullptr) {
+      ESP_LOGE(TAG, "Failed to allocate %u tap buffers of %u samples", this->buffer_count_, block_size);
+      return false;
+    }
+  }
+  this->filled_blocks_.init(this->buffer_count_);
+  this->free_buffers_.init(this->buffer_count_);
+  for (auto *b : this->buffers_)
+    this->free_buffers_.push(b);
+  xTaskCreatePinnedToCore(PcmTap::sender_task, "sound_level_meter_tap", TAP_TASK_STACK_SIZE, this, 1,
+                          &this->task_handle_, tskNO_AFFINITY);
+  return true;
 }
 
-/* SoundLevelMeterSensorMin */
+void PcmTap::dump_config(const char *prefix) {
+  ESP_LOGCONFIG(TAG, "%sTap: port %u, %u buffers, %luHz", prefix, this->port_, this->buffer_count_,
+                this->sample_rate_);
+}
 
-void SoundLevelMeterSensorMin::set_window_size(uint32_t window_size) {
-  this->window_samples_ = this->parent_->get_sample_rate() * (window_size / 1000.f);
+template<typename T> void PcmTap::write(const T *data, size_t len) {
+  if (!this->connected_.load(std::memory_order_relaxed))
+    return;
+  float *buffer;
+  if (!this->free_buffers_.pop(buffer)) {
+    this->dropped_blocks_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (std::is_same<T, float>::value) {
+    std::copy(data, data + len, buffer);
+  } else {
+    for (size_t i = 0; i < len; i++)
+      buffer[i] = std::ldexp(float(data[i]), -FIXED_POINT_FRAC_BITS);
+  }
+  // can't fail, there are only as many buffers as slots
+  this->filled_blocks_.push({buffer, len});
+  xTaskNotifyGive(this->task_handle_);
 }
 
-void SoundLevelMeterSensorMin::process(std::vector<float> &buffer) {
-  for (int i = 0; i < buffer.size(); i++) {
-    this->sum_ += buffer[i] * buffer[i];
-    this->count_sum_++;
-    if (this->count_sum_ == this->window_samples_) {
-      this->min_ = std::min(this->min_, this->sum_ / this->count_sum_);
-      this->sum_ = 0.f;
-      this->count_sum_ = 0;
+template void PcmTap::write(const float *data, size_t len);
+template void PcmTap::write(const int32_t *data, size_t len);
+
+bool PcmTap::is_connected() { return this->connected_.load(std::memory_order_relaxed); }
+
+uint32_t PcmTap::get_sent_blocks() { return this->sent_blocks_.load(std::memory_order_relaxed); }
+
+uint32_t PcmTap::get_dropped_blocks() { return this->dropped_blocks_.load(std::memory_order_relaxed); }
+
+size_t PcmTap::get_pending_blocks() { return this->buffers_.size() - this->free_buffers_.size(); }
+
+void PcmTap::sender_task(void *param) {
+  PcmTap *this_ = reinterpret_cast<PcmTap *>(param);
+  int server = -1;
+  while (1) {
+    if (server < 0 && (server = this_->listen_()) < 0) {
+      vTaskDelay(pdMS_TO_TICKS(TAP_RETRY_INTERVAL_MS));
+      continue;
     }
-    this->count_min_++;
-    if (this->count_min_ == this->update_samples_) {
-      float dB = 10 * log10(this->min_);
-      dB = this->adjust_dB(dB);
-      this->defer_publish_state(dB);
-      this->min_ = std::numeric_limits<float>::max();
-      this->count_min_ = 0;
+    int client = accept(server, nullptr, nullptr);
+    if (client < 0) {
+      ESP_LOGW(TAG, "Tap on port %u failed to accept connection: errno %d", this_->port_, errno);
+      close(server);
+      server = -1;
+      continue;
     }
+    this_->serve_(client);
+    close(client);
   }
 }
 
-void SoundLevelMeterSensorMin::reset() {
-  this->sum_ = 0.f;
-  this->min_ = std::numeric_limits<float>::max();
-  this->count_min_ = 0;
-  this->count_sum_ = 0;
-  this->defer_publish_state(NAN);
+int PcmTap::listen_() {
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    ESP_LOGW(TAG, "Tap on port %u failed to create socket: errno %d", this->port_, errno);
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(this->port_);
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+    ESP_LOGW(TAG, "Tap failed to listen on port %u: errno %d", this->port_, errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
 }
 
-/* SoundLevelMeterSensorPeak */
+static bool send_all(int fd, const void *data, size_t len) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// false once the client has closed the connection or it failed, doesn't block
+static bool is_client_open(int fd) {
+  uint8_t byte;
+  ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
 
-void SoundLevelMeterSensorPeak::process(std::vector<float> &buffer) {
-  for (int i = 0; i < buffer.size(); i++) {
-    this->peak_ = std::max(this->peak_, abs(buffer[i]));
-    this->count_++;
-    if (this->count_ == this->update_samples_) {
-      float dB = 20 * log10(this->peak_);
-      dB = this->adjust_dB(dB, false);
-      this->defer_publish_state(dB);
-      this->peak_ = 0.f;
-      this->count_ = 0;
+void PcmTap::serve_(int client) {
+  struct timeval timeout = {TAP_SEND_TIMEOUT_MS / 1000, 0};
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  // WAV header of a stream: mono IEEE float, sizes are unknown, so they are set to maximum
+  uint8_t header[WAV_HEADER_SIZE];
+  auto put = [&header](size_t pos, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++)
+      header[pos + i] = value >> (8 * i);
+  };
+  memcpy(header, "RIFF", 4);
+  put(4, UINT32_MAX, 4);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  put(16, 16, 4);
+  put(20, 3, 2);
+  put(22, 1, 2);
+  put(24, this->sample_rate_, 4);
+  put(28, this->sample_rate_ * sizeof(float), 4);
+  put(32, sizeof(float), 2);
+  put(34, 32, 2);
+  memcpy(header + 36, "data", 4);
+  put(40, UINT32_MAX, 4);
+
+  this->discard_blocks_();
+  uint32_t sent = this->get_sent_blocks();
+  uint32_t dropped = this->get_dropped_blocks();
+  ESP_LOGI(TAG, "Tap client connected on port %u", this->port_);
+  bool ok = send_all(client, header, sizeof(header));
+  this->connected_.store(ok, std::memory_order_relaxed);
+  while (ok) {
+    Block block;
+    if (!this->filled_blocks_.pop(block)) {
+      if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TAP_IDLE_CHECK_INTERVAL_MS)) == 0)
+        ok = is_client_open(client);
+      continue;
     }
+    ok = send_all(client, block.data, block.len * sizeof(float));
+    this->free_buffers_.push(block.data);
+    if (ok)
+      this->sent_blocks_.fetch_add(1, std::memory_order_relaxed);
   }
+  this->connected_.store(false, std::memory_order_relaxed);
+  ESP_LOGI(TAG, "Tap client disconnected from port %u: %lu blocks sent, %lu dropped", this->port_,
+           this->get_sent_blocks() - sent, this->get_dropped_blocks() - dropped);
 }
 
-void SoundLevelMeterSensorPeak::reset() {
-  this->peak_ = 0.f;
-  this->count_ = 0;
-  this->defer_publish_state(NAN);
+void PcmTap::discard_blocks_() {
+  Block block;
+  while (this->filled_blocks_.pop(block))
+    this->free_buffers_.push(block.data);
 }
+#endif
 
-/* SOS_Filter */
+/* LevelHistory */
 
-SOS_Filter::SOS_Filter(std::initializer_list<std::initializer_list<float>> &&coeffs) {
-  this->coeffs_.resize(coeffs.size());
-  this->state_.resize(coeffs.size(), {});
-  int i = 0;
-  for (auto &row : coeffs)
-    std::copy(row.begin(), row.end(), coeffs_[i++].begin());
+static size_t put_varint(uint8_t *data, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    data[n++] = value | 0x80;
+    value >>= 7;
+  }
+  data[n++] = value;
+  return n;
 }
 
-// direct form 2 transposed
-void SOS_Filter::process(std::vector<float> &data) {
-  int n = data.size();
-  int m = this->coeffs_.size();
-  for (int j = 0; j < m; j++) {
-    for (int i = 0; i < n; i++) {
-      // y[i] = b0 * x[i] + s0
-      float yi = this->coeffs_[j][0] * data[i] + this->state_[j][0];
-      // s0 = b1 * x[i] - a1 * y[i] + s1
-      this->state_[j][0] = this->coeffs_[j][1] * data[i] - this->coeffs_[j][3] * yi + this->state_[j][1];
-      // s1 = b2 * x[i] - a2 * y[i]
-      this->state_[j][1] = this->coeffs_[j][2] * data[i] - this->coeffs_[j][4] * yi;
+static uint32_t get_varint(const uint8_t *data, size_t &offset) {
+  uint32_t value = 0;
+  for (uint8_t shift = 0;; shift += 7) {
+    uint8_t b = data[offset++];
+    value |= uint32_t(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return value;
+  }
+}
 
-      data[i] = yi;
+bool LevelHistory::init(size_t size, const std::vector<sensor::Sensor *> &sensors) {
+  this->block_count_ = std::max<size_t>(size / HISTORY_BLOCK_SIZE, 2);
+  // external RAM if available, otherwise internal
+  RAMAllocator<uint8_t> allocator;
+  this->data_ = allocator.allocate(this->block_count_ * HISTORY_BLOCK_SIZE);
+  if (this->data_ == nullptr)
+    return false;
+  this->sensors_ = sensors;
+  this->writer_.values.resize(sensors.size());
+  this->reader_.values.resize(sensors.size());
+  for (size_t i = 0; i < sensors.size(); i++)
+    sensors[i]->add_on_state_callback([this, i](float state) { this->append(i, state, millis()); });
+  return true;
+}
+
+uint8_t *LevelHistory::block_(uint32_t block) { return this->data_ + block % this->block_count_ * HISTORY_BLOCK_SIZE; }
+
+uint32_t LevelHistory::oldest_block_() {
+  return this->writer_.block >= this->block_count_ ? this->writer_.block - this->block_count_ + 1 : 0;
+}
+
+void LevelHistory::start_block_(Cursor &cursor, uint32_t block) {
+  cursor.block = block;
+  cursor.offset = HISTORY_BLOCK_HEADER_SIZE;
+  cursor.index = 0;
+  cursor.time = 0;
+  std::fill(cursor.values.begin(), cursor.values.end(), 0);
+}
+
+void LevelHistory::append(uint8_t index, float value, uint32_t now) {
+  Cursor &w = this->writer_;
+  uint8_t *header = this->block_(w.block);
+  uint32_t start;
+  if (w.offset > 0)
+    memcpy(&start, header, sizeof(start));
+  if (w.offset == 0 || w.offset + HISTORY_MAX_RECORD_SIZE > HISTORY_BLOCK_SIZE ||
+      (now - start) / HISTORY_TIME_UNIT_MS < w.time) {
+    uint32_t block = w.offset == 0 ? w.block : w.block + 1;
+    // records of the overwritten block are lost, unless already exported
+    if (block >= this->block_count_ && this->reader_.block <= block - this->block_count_) {
+      uint16_t count;
+      memcpy(&count, this->block_(block) + 6, sizeof(count));
+      bool partly_read = this->reader_.block == block - this->block_count_ && this->reader_.offset > 0;
+      this->lost_records_ += count - (partly_read ? this->reader_.index : 0);
+    }
+    this->start_block_(w, block);
+    header = this->block_(block);
+    start = now;
+    memcpy(header, &start, sizeof(start));
+  }
+
+  uint8_t *data = header + w.offset;
+  size_t n = 0;
+  data[n++] = index;
+  uint32_t time = (now - start) / HISTORY_TIME_UNIT_MS;
+  n += put_varint(data + n, time - w.time);
+  w.time = time;
+  // 0 is NAN, otherwise zigzag coded difference plus one
+  if (std::isfinite(value) && std::abs(value) < HISTORY_MAX_VALUE) {
+    int32_t v = std::lround(value * HISTORY_VALUE_SCALE);
+    int32_t diff = v - w.values[index];
+    n += put_varint(data + n, ((uint32_t(diff) << 1) ^ uint32_t(diff >> 31)) + 1);
+    w.values[index] = v;
+  } else {
+    n += put_varint(data + n, 0);
+  }
+  w.offset += n;
+  w.index++;
+  uint16_t used = w.offset;
+  memcpy(header + 4, &used, sizeof(used));
+  memcpy(header + 6, &w.index, sizeof(w.index));
+  this->record_count_++;
+  this->encoded_size_ += n;
+}
+
+void LevelHistory::start_export() { this->exporting_ = true; }
+
+bool LevelHistory::is_exporting() { return this->exporting_; }
+
+void LevelHistory::export_batch(std::vector<HistoryRecord> &records, size_t max, uint32_t now) {
+  records.clear();
+  Cursor &r = this->reader_;
+  while (records.size() < max) {
+    // a block being read could be overwritten between batches, lost records are counted by append()
+    if (r.block < this->oldest_block_()) {
+      r.block = this->oldest_block_();
+      r.offset = 0;
     }
+    const uint8_t *header = this->block_(r.block);
+    uint16_t used = 0;
+    if (r.block < this->writer_.block || this->writer_.offset > 0)
+      memcpy(&used, header + 4, sizeof(used));
+    if (r.offset == 0)
+      this->start_block_(r, r.block);
+    if (r.offset >= used) {
+      if (r.block >= this->writer_.block) {
+        this->exporting_ = false;
+        return;
+      }
+      r.offset = 0;
+      r.block++;
+      continue;
+    }
+    uint32_t start;
+    memcpy(&start, header, sizeof(start));
+    uint8_t index = header[r.offset++];
+    r.time += get_varint(header, r.offset);
+    uint32_t code = get_varint(header, r.offset);
+    float value = NAN;
+    if (code > 0) {
+      uint32_t zigzag = code - 1;
+      r.values[index] += int32_t(zigzag >> 1) ^ -int32_t(zigzag & 1);
+      value = r.values[index] / HISTORY_VALUE_SCALE;
+    }
+    r.index++;
+    records.push_back({this->sensors_[index], value, now - start - r.time * HISTORY_TIME_UNIT_MS});
   }
 }
 
-void SOS_Filter::reset() {
-  for (auto &s : this->state_)
-    s = {0.f, 0.f};
+size_t LevelHistory::get_size() { return this->block_count_ * HISTORY_BLOCK_SIZE; }
+
+uint32_t LevelHistory::get_record_count() { return this->record_count_; }
+
+uint64_t LevelHistory::get_encoded_size() { return this->encoded_size_; }
+
+uint32_t LevelHistory::get_lost_records() { return this->lost_records_; }
+
+/* Sensor kernels */
+
+// Kernels over contiguous spans of samples between sensor boundaries. Every lane accumulates every
+// KERNEL_LANES-th sample, so iterations don't depend on each other and the compiler can vectorize
+// and unroll the loop without -ffast-math. For float, it changes only the order of rounding.
+
+template<typename T> static typename SampleTraits<T>::energy_t sum_squares(const T *data, size_t len) {
+  using Traits = SampleTraits<T>;
+  typename Traits::energy_t acc[KERNEL_LANES] = {};
+  size_t i = 0;
+  for (; i + KERNEL_LANES <= len; i += KERNEL_LANES) {
+    for (size_t j = 0; j < KERNEL_LANES; j++)
+      acc[j] += Traits::square(data[i + j]);
+  }
+  for (; i < len; i++)
+    acc[0] += Traits::square(data[i]);
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+#ifdef USE_SOUND_LEVEL_METER_ESP_DSP
+// esp-dsp has dot product optimized for ESP32 and ESP32-S3 (float only)
+template<> float sum_squares<float>(const float *data, size_t len) {
+  float sum = 0.f;
+  dsps_dotprod_f32(data, data, &sum, len);
+  return sum;
+}
+#endif
+
+template<typename T> static typename SampleTraits<T>::amplitude_t max_abs(const T *data, size_t len) {
+  using Traits = SampleTraits<T>;
+  typename Traits::amplitude_t acc[KERNEL_LANES] = {};
+  size_t i = 0;
+  for (; i + KERNEL_LANES <= len; i += KERNEL_LANES) {
+    for (size_t j = 0; j < KERNEL_LANES; j++)
+      acc[j] = std::max(acc[j], Traits::abs(data[i + j]));
+  }
+  for (; i < len; i++)
+    acc[0] = std::max(acc[0], Traits::abs(data[i]));
+  return std::max(std::max(acc[0], acc[1]), std::max(acc[2], acc[3]));
+}
+
+// both sums in a single pass over the data
+template<typename T> static void sum_squares_max_abs(const T *data, size_t len, SampleSegment<T> &segment) {
+#ifdef USE_SOUND_LEVEL_METER_ESP_DSP
+  if (std::is_same<T, float>::value) {
+    segment.energy = sum_squares(data, len);
+    segment.peak = max_abs(data, len);
+    return;
+  }
+#endif
+  using Traits = SampleTraits<T>;
+  typename Traits::energy_t energy[KERNEL_LANES] = {};
+  typename Traits::amplitude_t peak[KERNEL_LANES] = {};
+  size_t i = 0;
+  for (; i + KERNEL_LANES <= len; i += KERNEL_LANES) {
+    for (size_t j = 0; j < KERNEL_LANES; j++) {
+      energy[j] += Traits::square(data[i + j]);
+      peak[j] = std::max(peak[j], Traits::abs(data[i + j]));
+    }
+  }
+  for (; i < len; i++) {
+    energy[0] += Traits::square(data[i]);
+    peak[0] = std::max(peak[0], Traits::abs(data[i]));
+  }
+  segment.energy = (energy[0] + energy[1]) + (energy[2] + energy[3]);
+  segment.peak = std::max(std::max(peak[0], peak[1]), std::max(peak[2], peak[3]));
+}
+
+/* SensorGroup */
+
+void SensorGroup::set_parent(SoundLevelMeter *parent) { this->parent_ = parent; }
+void SensorGroup::add_sensor(SoundLevelMeterSensor *sensor) {
+  this->sensors_.push_back(sensor);
+  this->needs_energy_ |= sensor->needs_energy();
+  this->needs_peak_ |= sensor->needs_peak();
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  this->sensor_time_.push_back(0);
+#endif
+}
+void SensorGroup::add_group(SensorGroup *group) { this->groups_.push_back(group); }
+void SensorGroup::add_filter(Filter *filter) {
+  this->filters_.push_back(filter);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  this->filter_time_.push_back(0);
+#endif
+}
+void SensorGroup::set_filter_bank(FilterBank *filter_bank) { this->filter_bank_ = filter_bank; }
+
+#ifdef USE_SOUND_LEVEL_METER_TAP
+void SensorGroup::set_tap(PcmTap *tap) { this->tap_ = tap; }
+#endif
+
+void SensorGroup::set_sample_rate(float sample_rate) {
+  // own processing gets data after shared filters
+  for (size_t i = 0; i < this->first_filter_; i++)
+    sample_rate /= this->filters_[i]->get_decimation_factor();
+  this->sample_rate_ = sample_rate;
+  this->settle_samples_ = sample_rate * (this->parent_->get_warmup_interval() / 1000.f);
+  for (size_t i = this->first_filter_; i < this->filters_.size(); i++)
+    sample_rate /= this->filters_[i]->get_decimation_factor();
+  for (auto s : this->sensors_)
+    s->set_sample_rate(sample_rate);
+  for (auto g : this->groups_)
+    g->set_sample_rate(sample_rate);
+  if (this->filter_bank_ != nullptr)
+    this->filter_bank_->set_sample_rate(sample_rate);
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  // sample rate is set once in setup, tap streams blocks of at most buffer size at the output rate
+  if (this->tap_ != nullptr && !this->tap_->setup(sample_rate, this->parent_->get_buffer_size()))
+    this->tap_ = nullptr;
+#endif
+}
+
+void SensorGroup::dump_config(const char *prefix) {
+  if (!this->is_on_)
+    ESP_LOGCONFIG(TAG, "%sTurned off", prefix);
+  ESP_LOGCONFIG(TAG, "%sSensors:", prefix);
+  for (auto *s : this->sensors_) {
+    LOG_SENSOR((std::string(prefix) + "  ").c_str(), "Sound Pressure Level", s);
+    if (s->threshold_.has_value())
+      ESP_LOGCONFIG(TAG, "%s    Threshold: %.1fdB for %lums, hysteresis %.1fdB", prefix, *s->threshold_,
+                    s->threshold_duration_, s->threshold_hysteresis_);
+  }
+
+  if (this->groups_.size() > 0) {
+    ESP_LOGCONFIG(TAG, "%sGroups:", prefix);
+    for (int i = 0; i < this->groups_.size(); i++) {
+      ESP_LOGCONFIG(TAG, "%s  Group %u:", prefix, i);
+      this->groups_[i]->dump_config((std::string(prefix) + "    ").c_str());
+    }
+  }
+  if (this->filter_bank_ != nullptr)
+    this->filter_bank_->dump_config(prefix);
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  if (this->tap_ != nullptr)
+    this->tap_->dump_config(prefix);
+#endif
+}
+
+std::vector<SensorGroup *> SensorGroup::share_filters(const std::vector<SensorGroup *> &groups) {
+  for (auto g : groups)
+    g->exec_groups_ = share_filters(g->groups_);
+  return share_filters_(groups, 0);
+}
+
+// groups have the first `shared` filters in common, which are run by the shared group above them
+std::vector<SensorGroup *> SensorGroup::share_filters_(const std::vector<SensorGroup *> &groups, uint8_t shared) {
+  std::vector<SensorGroup *> result;
+  std::vector<bool> taken(groups.size(), false);
+  for (size_t i = 0; i < groups.size(); i++) {
+    if (taken[i])
+      continue;
+    auto *first = groups[i];
+    first->first_filter_ = shared;
+    // the rest of siblings continuing with the same filter, in their order
+    std::vector<SensorGroup *> members{first};
+    for (size_t j = i + 1; j < groups.size() && first->has_filters(); j++) {
+      auto &filters = groups[j]->filters_;
+      if (!taken[j] && filters.size() > shared && filters[shared] == first->filters_[shared]) {
+        members.push_back(groups[j]);
+        taken[j] = true;
+      }
+    }
+    if (members.size() == 1) {
+      result.push_back(first);
+      continue;
+    }
+    size_t n = shared + 1;
+    while (std::all_of(members.begin(), members.end(), [first, n](SensorGroup *g) {
+      return g->filters_.size() > n && g->filters_[n] == first->filters_[n];
+    }))
+      n++;
+    auto *group = new SensorGroup();
+    group->parent_ = first->parent_;
+    group->shared_ = true;
+    group->needed_ = false;
+    for (size_t k = shared; k < n; k++)
+      group->add_filter(first->filters_[k]);
+    group->exec_groups_ = share_filters_(members, n);
+    result.push_back(group);
+  }
+  return result;
+}
+
+void SensorGroup::build_plan() {
+  this->plan_.clear();
+  this->add_plan_steps_(this->plan_, 0, 0);
+  size_t slots = 1;
+  for (auto &step : this->plan_)
+    slots = std::max<size_t>(slots, step.output + 1);
+  this->slot_data_.resize(slots);
+  this->slot_len_.resize(slots);
+  for (auto g : this->exec_groups_)
+    g->build_plan();
+  if (this->filter_bank_ != nullptr)
+    this->filter_bank_->build_plan();
+}
+
+void SensorGroup::add_plan_steps_(std::vector<PlanStep> &plan, uint8_t input, uint8_t depth) {
+  uint8_t output = this->has_filters() ? ++depth : input;
+  size_t index = plan.size();
+  plan.push_back({this, nullptr, input, output, 0});
+  for (auto g : this->exec_groups_)
+    g->add_plan_steps_(plan, output, depth);
+  // filter bank gets all scratch buffers starting from the first one not used by this group
+  if (this->filter_bank_ != nullptr)
+    plan.push_back({nullptr, this->filter_bank_, output, depth, uint16_t(plan.size() + 1)});
+  plan[index].next = plan.size();
+}
+
+template<typename T> void SensorGroup::process(const T *data, size_t len, T *const *scratch) {
+  this->slot_data_[0] = data;
+  this->slot_len_[0] = len;
+  for (size_t i = 0; i < this->plan_.size();) {
+    auto &step = this->plan_[i];
+    if (step.group != nullptr && !step.group->active_) {
+      i = step.next;
+      continue;
+    }
+    i++;
+    const T *input = static_cast<const T *>(this->slot_data_[step.input]);
+    size_t n = this->slot_len_[step.input];
+    if (step.filter_bank != nullptr) {
+      step.filter_bank->process(input, n, scratch + step.output);
+      continue;
+    }
+    this->slot_data_[step.output] =
+        step.group->process_own(input, n, step.output != step.input ? scratch[step.output - 1] : nullptr);
+    this->slot_len_[step.output] = n;
+  }
+}
+
+template<typename T> const T *SensorGroup::process_own(const T *data, size_t &len, T *filtered) {
+  size_t input_len = len;
+  if (this->has_filters()) {
+    uint32_t settle_time = this->parent_->get_warmup_interval();
+    bool switched = false;
+    for (size_t i = this->first_filter_; i < this->filters_.size(); i++)
+      switched |= this->filters_[i]->apply_pending(settle_time);
+    if (switched)
+      this->restart(settle_time);
+    std::copy(data, data + len, filtered);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+    for (size_t i = this->first_filter_; i < this->filters_.size(); i++) {
+      auto start = esp_timer_get_time();
+      len = this->filters_[i]->process(filtered, len);
+      this->filter_time_[i] += esp_timer_get_time() - start;
+    }
+#else
+    for (size_t i = this->first_filter_; i < this->filters_.size(); i++)
+      len = this->filters_[i]->process(filtered, len);
+#endif
+    data = filtered;
+  }
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  if (this->tap_ != nullptr)
+    this->tap_->write(data, len);
+#endif
+
+  if (this->settle_left_ > 0) {
+    this->settle_left_ -= std::min<size_t>(this->settle_left_, input_len);
+    return data;
+  }
+  if (this->sensors_.size() > 0)
+    this->process_sensors_(data, len);
+  return data;
+}
+
+template<typename T> void SensorGroup::process_sensors_(const T *data, size_t len) {
+  while (len > 0) {
+    size_t n = len;
+    for (auto s : this->sensors_)
+      n = std::min<size_t>(n, s->get_samples_to_boundary());
+    SampleSegment<T> segment{0, 0, uint32_t(n)};
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+    auto start = esp_timer_get_time();
+#endif
+    if (this->needs_energy_ && this->needs_peak_)
+      sum_squares_max_abs(data, n, segment);
+    else if (this->needs_energy_)
+      segment.energy = sum_squares(data, n);
+    else
+      segment.peak = max_abs(data, n);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+    this->kernel_time_ += esp_timer_get_time() - start;
+    for (size_t i = 0; i < this->sensors_.size(); i++) {
+      start = esp_timer_get_time();
+      this->sensors_[i]->add_segment(segment);
+      this->sensor_time_[i] += esp_timer_get_time() - start;
+    }
+#else
+    for (auto s : this->sensors_)
+      s->add_segment(segment);
+#endif
+    data += n;
+    len -= n;
+  }
+}
+
+template void SensorGroup::process(const float *data, size_t len, float *const *scratch);
+template void SensorGroup::process(const int32_t *data, size_t len, int32_t *const *scratch);
+
+void SensorGroup::set_worker(uint8_t worker) {
+  for (auto s : this->sensors_)
+    s->worker_ = worker;
+  for (auto g : this->exec_groups_)
+    g->set_worker(worker);
+  if (this->filter_bank_ != nullptr)
+    this->filter_bank_->set_worker(worker);
+}
+
+float SensorGroup::get_own_cost(float &len) {
+  float cost = 0;
+  for (size_t i = this->first_filter_; i < this->filters_.size(); i++) {
+    cost += this->filters_[i]->get_cost() * len;
+    len /= this->filters_[i]->get_decimation_factor();
+  }
+  if (this->needs_energy_)
+    cost += ENERGY_COST_PER_SAMPLE * len;
+  if (this->needs_peak_)
+    cost += PEAK_COST_PER_SAMPLE * len;
+  return cost;
+}
+
+float SensorGroup::dump_plan(const char *prefix, float len) {
+  std::vector<float> slot_len(this->slot_len_.size(), 0.f);
+  slot_len[0] = len;
+  float total = 0;
+  for (size_t i = 0; i < this->plan_.size(); i++) {
+    auto &step = this->plan_[i];
+    float n = slot_len[step.input];
+    if (step.filter_bank != nullptr) {
+      ESP_LOGCONFIG(TAG, "%sStep %u: filter bank, slot %u", prefix, i, step.input);
+      total += step.filter_bank->dump_plan((std::string(prefix) + "  ").c_str(), n);
+      continue;
+    }
+    auto *g = step.group;
+    float cost = g->get_own_cost(n);
+    slot_len[step.output] = n;
+    if (g->shared_)
+      ESP_LOGCONFIG(TAG, "%sStep %u: slot %u -> %u, %u shared filters, %.0f MAC", prefix, i, step.input, step.output,
+                    g->filters_.size(), cost);
+    else
+      ESP_LOGCONFIG(TAG, "%sStep %u: slot %u -> %u, %u filters, %u sensors, %.0f MAC", prefix, i, step.input,
+                    step.output, g->filters_.size() - g->first_filter_, g->sensors_.size(), cost);
+    total += cost;
+  }
+  return total;
+}
+
+void SensorGroup::turn_on() {
+  this->is_on_ = true;
+  this->parent_->group_states_changed_ = true;
+}
+
+void SensorGroup::turn_off() {
+  this->is_on_ = false;
+  this->parent_->group_states_changed_ = true;
+}
+
+void SensorGroup::toggle() {
+  if (this->is_on_)
+    this->turn_off();
+  else
+    this->turn_on();
+}
+
+bool SensorGroup::is_on() { return this->is_on_; }
+
+bool SensorGroup::update_state(bool parent_on, bool initial) {
+  bool on = parent_on && this->is_on_;
+  // a group without needed sensors or tap is needed only for its nested groups or bands
+  bool active = on && this->needed_;
+  for (auto g : this->exec_groups_)
+    active |= g->update_state(on, initial);
+  if (this->filter_bank_ != nullptr)
+    active |= this->filter_bank_->update_state(on, initial);
+  if (!initial && active != this->active_) {
+    if (active)
+      this->settle_left_ = this->settle_samples_;
+    else
+      this->reset_own_();
+  }
+  this->active_ = active;
+  return active;
+}
+
+bool SensorGroup::update_needed() {
+  bool needed = std::any_of(this->sensors_.begin(), this->sensors_.end(), [](auto *s) { return s->is_needed(); });
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  needed |= this->tap_ != nullptr;
+#endif
+  bool changed = needed != this->needed_.exchange(needed);
+  for (auto g : this->groups_)
+    changed |= g->update_needed();
+  if (this->filter_bank_ != nullptr)
+    changed |= this->filter_bank_->update_needed();
+  return changed;
+}
+
+bool SensorGroup::is_active() { return this->active_; }
+
+const std::vector<SensorGroup *> &SensorGroup::get_exec_groups() { return this->exec_groups_; }
+bool SensorGroup::has_filters() { return this->filters_.size() > this->first_filter_; }
+bool SensorGroup::has_filter_bank() { return this->filter_bank_ != nullptr; }
+
+size_t SensorGroup::get_scratch_depth() {
+  size_t depth = 0;
+  for (auto g : this->exec_groups_)
+    depth = std::max(depth, g->get_scratch_depth());
+  if (this->filter_bank_ != nullptr)
+    depth = std::max(depth, this->filter_bank_->get_scratch_depth());
+  return depth + (this->has_filters() ? 1 : 0);
+}
+
+void SensorGroup::reset() {
+  this->reset_own_();
+  for (auto g : this->exec_groups_)
+    g->reset();
+  if (this->filter_bank_ != nullptr)
+    this->filter_bank_->reset();
+}
+
+void SensorGroup::restart(uint32_t settle_time) {
+  for (auto s : this->sensors_) {
+    s->reset();
+    s->reset_threshold_();
+  }
+  this->settle_left_ = std::max<uint32_t>(this->settle_left_, this->sample_rate_ * (settle_time / 1000.f));
+  // inactive groups start over anyway when they become active
+  for (auto g : this->exec_groups_)
+    if (g->active_)
+      g->restart(settle_time);
+  if (this->filter_bank_ != nullptr)
+    this->filter_bank_->restart(settle_time);
+}
+
+void SensorGroup::reset_own_() {
+  for (size_t i = this->first_filter_; i < this->filters_.size(); i++)
+    this->filters_[i]->reset();
+  for (auto s : this->sensors_) {
+    s->reset();
+    s->reset_threshold_();
+  }
+  this->settle_left_ = 0;
+}
+
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+uint64_t SensorGroup::get_profile_time() {
+  uint64_t t = 0;
+  for (auto ft : this->filter_time_)
+    t += ft;
+  t += this->kernel_time_;
+  for (auto st : this->sensor_time_)
+    t += st;
+  for (auto g : this->exec_groups_)
+    t += g->get_profile_time();
+  if (this->filter_bank_ != nullptr)
+    t += this->filter_bank_->get_profile_time();
+  return t;
+}
+
+void SensorGroup::dump_profile(const char *prefix, float audio_time) {
+  for (size_t i = this->first_filter_; i < this->filters_.size(); i++)
+    ESP_LOGI(TAG, "%sFilter %u: %.2f%%", prefix, i, this->filter_time_[i] / audio_time * 100);
+  if (this->sensors_.size() > 0)
+    ESP_LOGI(TAG, "%sSensor Kernel: %.2f%%", prefix, this->kernel_time_ / audio_time * 100);
+  for (size_t i = 0; i < this->sensors_.size(); i++) {
+    ESP_LOGI(TAG, "%sSensor '%s': %.2f%%", prefix, this->sensors_[i]->get_name().c_str(),
+             this->sensor_time_[i] / audio_time * 100);
+  }
+  std::string nested = std::string(prefix) + "  ";
+  for (size_t i = 0; i < this->groups_.size(); i++) {
+    ESP_LOGI(TAG, "%sGroup %u: %.2f%%", prefix, i, this->groups_[i]->get_profile_time() / audio_time * 100);
+    this->groups_[i]->dump_profile(nested.c_str(), audio_time);
+  }
+  uint64_t shared_time = get_shared_profile_time(this->exec_groups_);
+  if (shared_time > 0)
+    ESP_LOGI(TAG, "%sShared Filters: %.2f%%", prefix, shared_time / audio_time * 100);
+  if (this->filter_bank_ != nullptr) {
+    ESP_LOGI(TAG, "%sFilter Bank: %.2f%%", prefix, this->filter_bank_->get_profile_time() / audio_time * 100);
+    this->filter_bank_->dump_profile(nested.c_str(), audio_time);
+  }
+}
+
+void SensorGroup::reset_profile() {
+  std::fill(this->filter_time_.begin(), this->filter_time_.end(), 0);
+  this->kernel_time_ = 0;
+  std::fill(this->sensor_time_.begin(), this->sensor_time_.end(), 0);
+  for (auto g : this->exec_groups_)
+    g->reset_profile();
+  if (this->filter_bank_ != nullptr)
+    this->filter_bank_->reset_profile();
+}
+
+uint64_t SensorGroup::get_shared_profile_time(const std::vector<SensorGroup *> &exec_groups) {
+  uint64_t t = 0;
+  for (auto g : exec_groups) {
+    if (!g->shared_)
+      continue;
+    for (auto ft : g->filter_time_)
+      t += ft;
+    t += get_shared_profile_time(g->exec_groups_);
+  }
+  return t;
+}
+#endif
+
+/* FilterBank */
+
+void FilterBank::add_decimator(Filter *filter) {
+  this->decimators_.push_back(filter);
+  this->phases_.push_back(0);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  this->decimator_time_.push_back(0);
+#endif
+}
+
+void FilterBank::add_band(const char *name, uint8_t level, SensorGroup *band) {
+  auto it = std::upper_bound(this->bands_.begin(), this->bands_.end(), level,
+                             [](uint8_t level, const Band &b) { return level < b.level; });
+  this->bands_.insert(it, {name, level, band});
+}
+
+template<typename T> void FilterBank::process(const T *data, size_t len, T *const *scratch) {
+  T *decimated = *scratch++;
+  size_t level = 0;
+  for (auto &band : this->bands_) {
+    // decimation up to its level is done only when there is an active band at that level or above
+    if (!band.group->is_active())
+      continue;
+    for (; level < band.level; level++) {
+      // the input must stay intact, but after the first level decimation could be done in place
+      if (data != decimated)
+        std::copy(data, data + len, decimated);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+      auto start = esp_timer_get_time();
+      this->decimators_[level]->process(decimated, len);
+      this->decimator_time_[level] += esp_timer_get_time() - start;
+#else
+      this->decimators_[level]->process(decimated, len);
+#endif
+      auto &phase = this->phases_[level];
+      size_t n = 0;
+      for (size_t i = phase; i < len; i += 2)
+        decimated[n++] = decimated[i];
+      phase = (phase + len) % 2;
+      data = decimated;
+      len = n;
+    }
+    band.group->process(data, len, scratch);
+  }
+}
+
+template void FilterBank::process(const float *data, size_t len, float *const *scratch);
+template void FilterBank::process(const int32_t *data, size_t len, int32_t *const *scratch);
+
+size_t FilterBank::get_scratch_depth() {
+  size_t depth = 0;
+  for (auto &band : this->bands_)
+    depth = std::max(depth, band.group->get_scratch_depth());
+  return depth + 1;
+}
+
+void FilterBank::set_sample_rate(float sample_rate) {
+  this->sample_rate_ = sample_rate;
+  for (auto &band : this->bands_)
+    band.group->set_sample_rate(std::ldexp(sample_rate, -band.level));
+}
+
+void FilterBank::set_worker(uint8_t worker) {
+  for (auto &band : this->bands_)
+    band.group->set_worker(worker);
+}
+
+bool FilterBank::update_state(bool parent_on, bool initial) {
+  bool active = false;
+  for (auto &band : this->bands_)
+    active |= band.group->update_state(parent_on, initial);
+  return active;
+}
+
+bool FilterBank::update_needed() {
+  bool changed = false;
+  for (auto &band : this->bands_)
+    changed |= band.group->update_needed();
+  return changed;
+}
+
+void FilterBank::build_plan() {
+  for (auto &band : this->bands_)
+    band.group->build_plan();
+}
+
+float FilterBank::dump_plan(const char *prefix, float len) {
+  float total = 0;
+  size_t level = 0;
+  for (auto &band : this->bands_) {
+    for (; level < band.level; level++) {
+      total += this->decimators_[level]->get_cost() * len;
+      len /= 2;
+    }
+    ESP_LOGCONFIG(TAG, "%sBand %s:", prefix, band.name);
+    total += band.group->dump_plan((std::string(prefix) + "  ").c_str(), len);
+  }
+  return total;
+}
+
+void FilterBank::dump_config(const char *prefix) {
+  ESP_LOGCONFIG(TAG, "%sFilter Bank:", prefix);
+  for (auto &band : this->bands_) {
+    ESP_LOGCONFIG(TAG, "%s  Band %s (%.0f Hz sample rate):", prefix, band.name,
+                  std::ldexp(this->sample_rate_, -band.level));
+    band.group->dump_config((std::string(prefix) + "    ").c_str());
+  }
+}
+
+void FilterBank::reset() {
+  for (auto f : this->decimators_)
+    f->reset();
+  std::fill(this->phases_.begin(), this->phases_.end(), 0);
+  for (auto &band : this->bands_)
+    band.group->reset();
+}
+
+void FilterBank::restart(uint32_t settle_time) {
+  // decimators are not reset: their delay is much shorter than settle time
+  for (auto &band : this->bands_)
+    if (band.group->is_active())
+      band.group->restart(settle_time);
+}
+
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+uint64_t FilterBank::get_profile_time() {
+  uint64_t t = 0;
+  for (auto dt : this->decimator_time_)
+    t += dt;
+  for (auto &band : this->bands_)
+    t += band.group->get_profile_time();
+  return t;
+}
+
+void FilterBank::dump_profile(const char *prefix, float audio_time) {
+  for (size_t i = 0; i < this->decimators_.size(); i++)
+    ESP_LOGI(TAG, "%sDecimator %u: %.2f%%", prefix, i, this->decimator_time_[i] / audio_time * 100);
+  std::string nested = std::string(prefix) + "  ";
+  for (auto &band : this->bands_) {
+    ESP_LOGI(TAG, "%sBand %s: %.2f%%", prefix, band.name, band.group->get_profile_time() / audio_time * 100);
+    band.group->dump_profile(nested.c_str(), audio_time);
+  }
+}
+
+void FilterBank::reset_profile() {
+  std::fill(this->decimator_time_.begin(), this->decimator_time_.end(), 0);
+  for (auto &band : this->bands_)
+    band.group->reset_profile();
+}
+#endif
+
+/* SlidingSum */
+
+void SlidingSum::init(size_t capacity) {
+  this->values_.resize(capacity);
+  this->clear();
+}
+
+void SlidingSum::push(float value) {
+  if (this->size_ == this->values_.size())
+    this->sum_ -= this->values_[this->next_];
+  else
+    this->size_++;
+  this->values_[this->next_] = value;
+  this->sum_ += value;
+  if (++this->next_ == this->values_.size()) {
+    this->next_ = 0;
+    // running sum is recalculated once per window, so that rounding errors don't accumulate
+    this->sum_ = 0.;
+    for (float v : this->values_)
+      this->sum_ += v;
+  }
+}
+
+void SlidingSum::clear() {
+  this->next_ = 0;
+  this->size_ = 0;
+  this->sum_ = 0.;
+}
+
+/* SoundLevelMeterSensor */
+
+void SoundLevelMeterSensor::set_parent(SoundLevelMeter *parent) {
+  this->parent_ = parent;
+  this->update_interval_ = parent->get_update_interval();
+}
+
+void SoundLevelMeterSensor::set_update_interval(uint32_t update_interval) { this->update_interval_ = update_interval; }
+
+void SoundLevelMeterSensor::set_sample_rate(float sample_rate) {
+  // at least one sample, so that every segment makes progress
+  this->update_samples_ = std::max(1.f, sample_rate * (this->update_interval_ / 1000.f));
+  if (this->threshold_.has_value()) {
+    // inverse of adjust_dB()
+    bool is_rms = this->needs_energy();
+    float scale = is_rms ? 10.f : 20.f;
+    float offset = this->adjust_dB(0.f, is_rms);
+    this->threshold_level_ = std::pow(10.f, (*this->threshold_ - offset) / scale);
+    this->rearm_level_ = std::pow(10.f, (*this->threshold_ - this->threshold_hysteresis_ - offset) / scale);
+    this->threshold_samples_ = sample_rate * (this->threshold_duration_ / 1000.f);
+  }
+}
+
+void SoundLevelMeterSensor::defer_publish_state(float state) {
+  this->parent_->enqueue_publish(this->worker_, this, state);
+}
+
+void SoundLevelMeterSensor::set_threshold(float threshold) { this->threshold_ = threshold; }
+void SoundLevelMeterSensor::set_threshold_duration(uint32_t threshold_duration) {
+  this->threshold_duration_ = threshold_duration;
+}
+void SoundLevelMeterSensor::set_threshold_hysteresis(float threshold_hysteresis) {
+  this->threshold_hysteresis_ = threshold_hysteresis;
+}
+void SoundLevelMeterSensor::set_publish_on_threshold(bool publish_on_threshold) {
+  this->publish_on_threshold_ = publish_on_threshold;
+}
+void SoundLevelMeterSensor::add_on_threshold_callback(std::function<void(float)> &&callback) {
+  this->threshold_callback_.add(std::move(callback));
+}
+
+void SoundLevelMeterSensor::set_referenced(bool referenced) { this->referenced_ = referenced; }
+
+bool SoundLevelMeterSensor::is_needed() {
+  return !this->is_internal() || this->referenced_ || this->threshold_.has_value() || this->callback_.size() > 0 ||
+         this->raw_callback_.size() > 0;
+}
+
+void SoundLevelMeterSensor::publish_threshold(float level) {
+  if (this->publish_on_threshold_)
+    this->publish_state(level);
+  this->threshold_callback_.call(level);
+}
+
+void SoundLevelMeterSensor::check_threshold_(float level, uint32_t len) {
+  // threshold_level_ is infinite without threshold, so this is the only check on the common path
+  if (!(level >= this->threshold_level_)) {
+    this->above_threshold_samples_ = 0;
+    if (level < this->rearm_level_)
+      this->threshold_triggered_ = false;
+    return;
+  }
+  this->above_threshold_samples_ += len;
+  if (this->threshold_triggered_ || this->above_threshold_samples_ < this->threshold_samples_)
+    return;
+  this->threshold_triggered_ = true;
+  bool is_rms = this->needs_energy();
+  float dB = this->adjust_dB((is_rms ? 10 : 20) * log10(level), is_rms);
+  this->parent_->enqueue_threshold(this->worker_, this, dB);
+}
+
+void SoundLevelMeterSensor::reset_threshold_() {
+  this->above_threshold_samples_ = 0;
+  this->threshold_triggered_ = false;
+}
+
+float SoundLevelMeterSensor::adjust_dB(float dB, bool is_rms) {
+  // see: https://dsp.stackexchange.com/a/50947/65262
+  if (is_rms)
+    dB += DBFS_OFFSET;
+
+  // see: https://invensense.tdk.com/wp-content/uploads/2015/02/AN-1112-v1.1.pdf
+  // dBSPL = dBFS + mic_sensitivity_ref - mic_sensitivity
+  // e.g. dBSPL = dBFS + 94 - (-26) = dBFS + 120
+  if (this->parent_->get_mic_sensitivity().has_value() && this->parent_->get_mic_sensitivity_ref().has_value())
+    dB += *this->parent_->get_mic_sensitivity_ref() - *this->parent_->get_mic_sensitivity();
+
+  if (this->parent_->get_offset().has_value())
+    dB += *this->parent_->get_offset();
+
+  return dB;
+}
+
+/* SoundLevelMeterSensorEq */
+
+void SoundLevelMeterSensorEq::set_sliding_window(uint32_t sliding_window) { this->sliding_window_ = sliding_window; }
+
+void SoundLevelMeterSensorEq::set_sample_rate(float sample_rate) {
+  SoundLevelMeterSensor::set_sample_rate(sample_rate);
+  if (this->sliding_window_ > 0)
+    this->sliding_sum_.init(std::max(1.f, std::round(float(this->sliding_window_) / this->update_interval_)));
+}
+
+uint32_t SoundLevelMeterSensorEq::get_samples_to_boundary() { return this->update_samples_ - this->count_; }
+void SoundLevelMeterSensorEq::add_segment(const SampleSegment<float> &segment) { this->add_segment_(segment); }
+void SoundLevelMeterSensorEq::add_segment(const SampleSegment<int32_t> &segment) { this->add_segment_(segment); }
+
+template<typename T> void SoundLevelMeterSensorEq::add_segment_(const SampleSegment<T> &segment) {
+  // segments are short, so adding their sums to global sum (which could become quite large
+  // for large accumulating periods, like 1 hour) doesn't lose precision as long as it is double
+  double energy = SampleTraits<T>::to_energy(segment.energy);
+  this->sum_ += energy;
+  this->count_ += segment.len;
+  this->check_threshold_(energy / segment.len, segment.len);
+  if (this->count_ == this->update_samples_) {
+    double mean = this->sum_ / this->count_;
+    if (this->sliding_window_ > 0) {
+      this->sliding_sum_.push(mean);
+      mean = this->sliding_sum_.sum() / this->sliding_sum_.size();
+    }
+    float dB = 10 * log10(mean);
+    dB = this->adjust_dB(dB);
+    this->defer_publish_state(dB);
+    this->sum_ = 0;
+    this->count_ = 0;
+  }
+}
+
+void SoundLevelMeterSensorEq::reset() {
+  this->sum_ = 0.;
+  this->count_ = 0;
+  this->sliding_sum_.clear();
+  this->defer_publish_state(NAN);
+}
+
+/* SoundLevelMeterSensorMax */
+
+void SoundLevelMeterSensorMax::set_window_size(uint32_t window_size) { this->window_size_ = window_size; }
+void SoundLevelMeterSensorMax::set_sliding_window(uint32_t sliding_window) { this->sliding_window_ = sliding_window; }
+
+void SoundLevelMeterSensorMax::set_sample_rate(float sample_rate) {
+  SoundLevelMeterSensor::set_sample_rate(sample_rate);
+  this->window_samples_ = std::max(1.f, sample_rate * (this->window_size_ / 1000.f));
+  if (this->sliding_window_ > 0)
+    this->sliding_max_.init(std::max(1.f, std::round(float(this->sliding_window_) / this->window_size_)));
+}
+
+uint32_t SoundLevelMeterSensorMax::get_samples_to_boundary() {
+  return std::min(this->window_samples_ - this->count_sum_, this->update_samples_ - this->count_max_);
+}
+void SoundLevelMeterSensorMax::add_segment(const SampleSegment<float> &segment) {
+  this->add_segment_(segment, this->sum_);
+}
+void SoundLevelMeterSensorMax::add_segment(const SampleSegment<int32_t> &segment) {
+  this->add_segment_(segment, this->sum_fixed_);
+}
+
+template<typename T>
+void SoundLevelMeterSensorMax::add_segment_(const SampleSegment<T> &segment, typename SampleTraits<T>::energy_t &sum) {
+  sum += segment.energy;
+  this->count_sum_ += segment.len;
+  if (this->count_sum_ == this->window_samples_) {
+    float mean = SampleTraits<T>::to_energy(sum) / this->count_sum_;
+    this->check_threshold_(mean, this->count_sum_);
+    if (this->sliding_window_ > 0)
+      this->sliding_max_.push(mean);
+    else
+      this->max_ = std::max(this->max_, mean);
+    sum = 0;
+    this->count_sum_ = 0;
+  }
+  this->count_max_ += segment.len;
+  if (this->count_max_ == this->update_samples_) {
+    float dB = 10 * log10(this->sliding_window_ > 0 ? this->sliding_max_.get() : this->max_);
+    dB = this->adjust_dB(dB);
+    this->defer_publish_state(dB);
+    this->max_ = std::numeric_limits<float>::min();
+    this->count_max_ = 0;
+  }
+}
+
+void SoundLevelMeterSensorMax::reset() {
+  this->sum_ = 0.f;
+  this->sum_fixed_ = 0;
+  this->sliding_max_.clear();
+  this->max_ = std::numeric_limits<float>::min();
+  this->count_max_ = 0;
+  this->count_sum_ = 0;
+  this->defer_publish_state(NAN);
+}
+
+/* SoundLevelMeterSensorMin */
+
+void SoundLevelMeterSensorMin::set_window_size(uint32_t window_size) { this->window_size_ = window_size; }
+void SoundLevelMeterSensorMin::set_sliding_window(uint32_t sliding_window) { this->sliding_window_ = sliding_window; }
+
+void SoundLevelMeterSensorMin::set_sample_rate(float sample_rate) {
+  SoundLevelMeterSensor::set_sample_rate(sample_rate);
+  this->window_samples_ = std::max(1.f, sample_rate * (this->window_size_ / 1000.f));
+  if (this->sliding_window_ > 0)
+    this->sliding_min_.init(std::max(1.f, std::round(float(this->sliding_window_) / this->window_size_)));
+}
+
+uint32_t SoundLevelMeterSensorMin::get_samples_to_boundary() {
+  return std::min(this->window_samples_ - this->count_sum_, this->update_samples_ - this->count_min_);
+}
+void SoundLevelMeterSensorMin::add_segment(const SampleSegment<float> &segment) {
+  this->add_segment_(segment, this->sum_);
+}
+void SoundLevelMeterSensorMin::add_segment(const SampleSegment<int32_t> &segment) {
+  this->add_segment_(segment, this->sum_fixed_);
+}
+
+template<typename T>
+void SoundLevelMeterSensorMin::add_segment_(const SampleSegment<T> &segment, typename SampleTraits<T>::energy_t &sum) {
+  sum += segment.energy;
+  this->count_sum_ += segment.len;
+  if (this->count_sum_ == this->window_samples_) {
+    float mean = SampleTraits<T>::to_energy(sum) / this->count_sum_;
+    this->check_threshold_(mean, this->count_sum_);
+    if (this->sliding_window_ > 0)
+      this->sliding_min_.push(mean);
+    else
+      this->min_ = std::min(this->min_, mean);
+    sum = 0;
+    this->count_sum_ = 0;
+  }
+  this->count_min_ += segment.len;
+  if (this->count_min_ == this->update_samples_) {
+    float dB = 10 * log10(this->sliding_window_ > 0 ? this->sliding_min_.get() : this->min_);
+    dB = this->adjust_dB(dB);
+    this->defer_publish_state(dB);
+    this->min_ = std::numeric_limits<float>::max();
+    this->count_min_ = 0;
+  }
+}
+
+void SoundLevelMeterSensorMin::reset() {
+  this->sum_ = 0.f;
+  this->sum_fixed_ = 0;
+  this->sliding_min_.clear();
+  this->min_ = std::numeric_limits<float>::max();
+  this->count_min_ = 0;
+  this->count_sum_ = 0;
+  this->defer_publish_state(NAN);
+}
+
+/* SoundLevelMeterSensorPeak */
+
+uint32_t SoundLevelMeterSensorPeak::get_samples_to_boundary() { return this->update_samples_ - this->count_; }
+void SoundLevelMeterSensorPeak::add_segment(const SampleSegment<float> &segment) {
+  this->add_segment_(segment, this->peak_);
+}
+void SoundLevelMeterSensorPeak::add_segment(const SampleSegment<int32_t> &segment) {
+  this->add_segment_(segment, this->peak_fixed_);
+}
+
+template<typename T>
+void SoundLevelMeterSensorPeak::add_segment_(const SampleSegment<T> &segment,
+                                             typename SampleTraits<T>::amplitude_t &peak) {
+  peak = std::max(peak, segment.peak);
+  this->count_ += segment.len;
+  this->check_threshold_(SampleTraits<T>::to_amplitude(segment.peak), segment.len);
+  if (this->count_ == this->update_samples_) {
+    float dB = 20 * log10(SampleTraits<T>::to_amplitude(peak));
+    dB = this->adjust_dB(dB, false);
+    this->defer_publish_state(dB);
+    peak = 0;
+    this->count_ = 0;
+  }
+}
+
+void SoundLevelMeterSensorPeak::reset() {
+  this->peak_ = 0.f;
+  this->peak_fixed_ = 0;
+  this->count_ = 0;
+  this->defer_publish_state(NAN);
+}
+
+/* SoundLevelMeterSensorTimeWeighted */
+
+void SoundLevelMeterSensorTimeWeighted::set_time_weighting(TimeWeighting time_weighting) {
+  this->time_weighting_ = time_weighting;
+}
+
+void SoundLevelMeterSensorTimeWeighted::set_statistic(TimeWeightedStatistic statistic) {
+  this->statistic_ = statistic;
+}
+
+void SoundLevelMeterSensorTimeWeighted::set_sample_rate(float sample_rate) {
+  SoundLevelMeterSensor::set_sample_rate(sample_rate);
+  this->envelope_samples_ = std::max(1.f, std::round(sample_rate / TIME_WEIGHTING_ENVELOPE_RATE));
+  float dt = this->envelope_samples_ / sample_rate;
+  float rise_tau, fall_tau;
+  switch (this->time_weighting_) {
+    case TIME_WEIGHTING_SLOW:
+      rise_tau = fall_tau = 1.f;
+      break;
+    case TIME_WEIGHTING_IMPULSE:
+      rise_tau = 0.035f;
+      fall_tau = 1.5f;
+      break;
+    default:
+      rise_tau = fall_tau = 0.125f;
+      break;
+  }
+  this->rise_alpha_ = 1.f - std::exp(-dt / rise_tau);
+  this->fall_alpha_ = 1.f - std::exp(-dt / fall_tau);
+}
+
+uint32_t SoundLevelMeterSensorTimeWeighted::get_samples_to_boundary() {
+  return std::min(this->envelope_samples_ - this->count_envelope_, this->update_samples_ - this->count_update_);
+}
+void SoundLevelMeterSensorTimeWeighted::add_segment(const SampleSegment<float> &segment) {
+  this->add_segment_(segment);
+}
+void SoundLevelMeterSensorTimeWeighted::add_segment(const SampleSegment<int32_t> &segment) {
+  this->add_segment_(segment);
+}
+
+template<typename T> void SoundLevelMeterSensorTimeWeighted::add_segment_(const SampleSegment<T> &segment) {
+  this->sum_ += SampleTraits<T>::to_energy(segment.energy);
+  this->count_envelope_ += segment.len;
+  this->count_update_ += segment.len;
+
+  if (this->count_envelope_ == this->envelope_samples_) {
+    float mean = this->sum_ / this->envelope_samples_;
+    if (std::isnan(this->level_))
+      this->level_ = mean;
+    else
+      this->level_ += (mean - this->level_) * (mean > this->level_ ? this->rise_alpha_ : this->fall_alpha_);
+    this->check_threshold_(this->level_, this->envelope_samples_);
+    if (this->statistic_ == TIME_WEIGHTED_MAX)
+      this->stat_ = std::isnan(this->stat_) ? this->level_ : std::max(this->stat_, this->level_);
+    else if (this->statistic_ == TIME_WEIGHTED_MIN)
+      this->stat_ = std::isnan(this->stat_) ? this->level_ : std::min(this->stat_, this->level_);
+    else
+      this->stat_ = this->level_;
+    this->sum_ = 0.f;
+    this->count_envelope_ = 0;
+  }
+
+  if (this->count_update_ == this->update_samples_) {
+    float dB = 10 * log10(this->stat_);
+    dB = this->adjust_dB(dB);
+    this->defer_publish_state(dB);
+    this->stat_ = NAN;
+    this->count_update_ = 0;
+  }
+}
+
+void SoundLevelMeterSensorTimeWeighted::reset() {
+  this->level_ = NAN;
+  this->stat_ = NAN;
+  this->sum_ = 0.f;
+  this->count_envelope_ = 0;
+  this->count_update_ = 0;
+  this->defer_publish_state(NAN);
+}
+
+/* SoundLevelMeterSensorPercentile */
+
+void SoundLevelMeterSensorPercentile::set_window_size(uint32_t window_size) { this->window_size_ = window_size; }
+void SoundLevelMeterSensorPercentile::set_percentile(float percentile) { this->percentile_ = percentile; }
+
+void SoundLevelMeterSensorPercentile::set_sample_rate(float sample_rate) {
+  SoundLevelMeterSensor::set_sample_rate(sample_rate);
+  this->window_samples_ = std::max(1.f, sample_rate * (this->window_size_ / 1000.f));
+  this->histogram_.assign((HISTOGRAM_MAX_DB - HISTOGRAM_MIN_DB) * HISTOGRAM_BINS_PER_DB + 1, 0);
+}
+
+uint32_t SoundLevelMeterSensorPercentile::get_samples_to_boundary() {
+  return std::min(this->window_samples_ - this->count_window_, this->update_samples_ - this->count_update_);
+}
+void SoundLevelMeterSensorPercentile::add_segment(const SampleSegment<float> &segment) { this->add_segment_(segment); }
+void SoundLevelMeterSensorPercentile::add_segment(const SampleSegment<int32_t> &segment) {
+  this->add_segment_(segment);
+}
+
+template<typename T> void SoundLevelMeterSensorPercentile::add_segment_(const SampleSegment<T> &segment) {
+  this->sum_ += SampleTraits<T>::to_energy(segment.energy);
+  this->count_window_ += segment.len;
+  this->count_update_ += segment.len;
+
+  if (this->count_window_ == this->window_samples_) {
+    this->check_threshold_(this->sum_ / this->window_samples_, this->window_samples_);
+    this->add_level(this->sum_ / this->window_samples_);
+    this->sum_ = 0.f;
+    this->count_window_ = 0;
+  }
+
+  if (this->count_update_ == this->update_samples_) {
+    float dB = this->get_level();
+    dB = this->adjust_dB(dB);
+    this->defer_publish_state(dB);
+    std::fill(this->histogram_.begin(), this->histogram_.end(), 0);
+    this->histogram_count_ = 0;
+    this->count_update_ = 0;
+  }
+}
+
+void SoundLevelMeterSensorPercentile::add_level(float mean_square) {
+  float bin = std::round((10 * log10(mean_square) - HISTOGRAM_MIN_DB) * HISTOGRAM_BINS_PER_DB);
+  // NaN and -inf (digital silence) go to the first bin
+  if (!(bin >= 0.f))
+    bin = 0.f;
+  this->histogram_[std::min<size_t>(bin, this->histogram_.size() - 1)]++;
+  this->histogram_count_++;
+}
+
+float SoundLevelMeterSensorPercentile::get_level() {
+  if (this->histogram_count_ == 0)
+    return NAN;
+  // LN is exceeded during N percent of time, so counting goes from the loudest bin
+  float target = this->histogram_count_ * this->percentile_ / 100.f;
+  uint32_t count = 0;
+  size_t bin = this->histogram_.size();
+  while (bin > 0) {
+    count += this->histogram_[--bin];
+    if (count >= target && count > 0)
+      break;
+  }
+  return HISTOGRAM_MIN_DB + bin / HISTOGRAM_BINS_PER_DB;
+}
+
+void SoundLevelMeterSensorPercentile::reset() {
+  std::fill(this->histogram_.begin(), this->histogram_.end(), 0);
+  this->histogram_count_ = 0;
+  this->sum_ = 0.f;
+  this->count_window_ = 0;
+  this->count_update_ = 0;
+  this->defer_publish_state(NAN);
+}
+
+#ifdef USE_TIME
+/* SoundLevelMeterSensorExposure */
+
+// intervals are passed to the main loop once per update interval, so a few slots are plenty
+static const size_t EXPOSURE_QUEUE_SIZE = 4;
+static const float EXPOSURE_REFERENCE_DURATION = 8 * 3600.f;
+// Lden periods (local time) and their penalties
+static const uint8_t LDEN_DAY_START_HOUR = 7;
+static const uint8_t LDEN_EVENING_START_HOUR = 19;
+static const uint8_t LDEN_NIGHT_START_HOUR = 23;
+static const float LDEN_PENALTY_DB[] = {0.f, 5.f, 10.f};
+// changes whenever the layout of persisted state changes, so that old state is not misread
+static const uint32_t EXPOSURE_STATE_VERSION = 1;
+
+void SoundLevelMeterSensorExposure::set_time(time::RealTimeClock *time) { this->time_ = time; }
+void SoundLevelMeterSensorExposure::set_metric(ExposureMetric metric) { this->metric_ = metric; }
+void SoundLevelMeterSensorExposure::set_criterion_level(float criterion_level) {
+  this->criterion_level_ = criterion_level;
+}
+void SoundLevelMeterSensorExposure::set_checkpoint_interval(uint32_t checkpoint_interval) {
+  this->checkpoint_interval_ = checkpoint_interval;
+}
+void SoundLevelMeterSensorExposure::set_day_start_hour(uint8_t day_start_hour) {
+  this->day_start_hour_ = day_start_hour;
+}
+
+void SoundLevelMeterSensorExposure::set_sample_rate(float sample_rate) {
+  SoundLevelMeterSensor::set_sample_rate(sample_rate);
+  this->sample_rate_ = sample_rate;
+  this->intervals_.init(EXPOSURE_QUEUE_SIZE);
+}
+
+uint32_t SoundLevelMeterSensorExposure::get_samples_to_boundary() {
+  return this->update_samples_ - this->count_ % this->update_samples_;
+}
+void SoundLevelMeterSensorExposure::add_segment(const SampleSegment<float> &segment) { this->add_segment_(segment); }
+void SoundLevelMeterSensorExposure::add_segment(const SampleSegment<int32_t> &segment) {
+  this->add_segment_(segment);
+}
+
+template<typename T> void SoundLevelMeterSensorExposure::add_segment_(const SampleSegment<T> &segment) {
+  this->sum_ += SampleTraits<T>::to_energy(segment.energy);
+  this->count_ += segment.len;
+  // if the main loop doesn't keep up, the interval is merged with the next one rather than lost
+  if (this->count_ % this->update_samples_ == 0 && this->intervals_.push({this->sum_, this->count_})) {
+    this->sum_ = 0.;
+    this->count_ = 0;
+  }
+}
+
+void SoundLevelMeterSensorExposure::setup() {
+  this->pref_ = global_preferences->make_preference<State>(this->get_object_id_hash() ^ EXPOSURE_STATE_VERSION);
+  if (this->pref_.load(&this->state_)) {
+    ESP_LOGD(TAG, "'%s': Restored exposure state of %lu", this->get_name().c_str(), this->state_.date);
+  } else {
+    this->state_ = {};
+  }
+  this->last_checkpoint_ = millis();
+}
+
+void SoundLevelMeterSensorExposure::loop() {
+  Interval interval;
+  while (this->intervals_.pop(interval))
+    this->add_interval_(interval);
+  if (this->dirty_ && millis() - this->last_checkpoint_ >= this->checkpoint_interval_)
+    this->checkpoint_();
+}
+
+void SoundLevelMeterSensorExposure::on_shutdown() {
+  if (this->dirty_)
+    this->checkpoint_();
+}
+
+void SoundLevelMeterSensorExposure::add_interval_(const Interval &interval) {
+  float duration = interval.count / this->sample_rate_;
+  // calibration is applied in dB, so the level of the interval is converted back to energy
+  float dB = this->adjust_dB(10 * log10(interval.sum / interval.count));
+  double energy = std::pow(10., dB / 10.) * duration;
+  ESPTime now = this->time_->now();
+  if (!now.is_valid()) {
+    // until time is synced there is no day or period to add to, energy is kept and added to the first one
+    this->unsynced_energy_ += energy;
+    this->unsynced_duration_ += duration;
+    return;
+  }
+  if (this->unsynced_duration_ > 0) {
+    ESP_LOGD(TAG, "'%s': Adding %.0fs of audio recorded before time was synced", this->get_name().c_str(),
+             this->unsynced_duration_);
+    energy += this->unsynced_energy_;
+    duration += this->unsynced_duration_;
+    this->unsynced_energy_ = 0.;
+    this->unsynced_duration_ = 0.f;
+  }
+  // the day is counted from day_start_hour, so e.g. at 3:00 with day start at 7:00 it is the previous date
+  ESPTime day = ESPTime::from_epoch_local(now.timestamp - time_t(this->day_start_hour_) * 3600);
+  uint32_t date = day.year * 1000 + day.day_of_year;
+  if (date != this->state_.date)
+    this->state_ = {date, {}, {}};
+  Period period = PERIOD_NIGHT;
+  if (now.hour >= LDEN_DAY_START_HOUR && now.hour < LDEN_EVENING_START_HOUR)
+    period = PERIOD_DAY;
+  else if (now.hour >= LDEN_EVENING_START_HOUR && now.hour < LDEN_NIGHT_START_HOUR)
+    period = PERIOD_EVENING;
+  this->state_.energy[period] += energy;
+  this->state_.duration[period] += duration;
+  this->dirty_ = true;
+  this->publish_state(this->get_value_());
+}
+
+float SoundLevelMeterSensorExposure::get_value_() {
+  double energy = 0., weighted = 0.;
+  float duration = 0.f;
+  for (int i = 0; i < PERIOD_COUNT; i++) {
+    energy += this->state_.energy[i];
+    weighted += this->state_.energy[i] * std::pow(10., LDEN_PENALTY_DB[i] / 10.);
+    duration += this->state_.duration[i];
+  }
+  switch (this->metric_) {
+    case EXPOSURE_LEX_8H:
+      return 10 * log10(energy / EXPOSURE_REFERENCE_DURATION);
+    case EXPOSURE_DOSE:
+      return 100 * energy / (std::pow(10., this->criterion_level_ / 10.) * EXPOSURE_REFERENCE_DURATION);
+    case EXPOSURE_LDEN:
+      return duration > 0 ? 10 * log10(weighted / duration) : NAN;
+  }
+  return NAN;
+}
+
+void SoundLevelMeterSensorExposure::checkpoint_() {
+  // written to flash by ESPHome within flash_write_interval
+  this->pref_.save(&this->state_);
+  this->dirty_ = false;
+  this->last_checkpoint_ = millis();
+}
+
+void SoundLevelMeterSensorExposure::reset() {
+  // only the current interval is dropped, the day goes on and the value is published again after the next one
+  this->sum_ = 0.;
+  this->count_ = 0;
+  this->defer_publish_state(NAN);
+}
+#endif
+
+/* SOS_Filter */
+
+SOS_Filter::SOS_Filter(std::initializer_list<std::initializer_list<float>> &&coeffs) {
+  this->coeffs_.resize(coeffs.size());
+  this->state_.resize(coeffs.size(), {});
+  this->coeffs_fixed_.resize(coeffs.size());
+  this->state_fixed_.resize(coeffs.size(), {});
+  int i = 0;
+  for (auto &row : coeffs)
+    std::copy(row.begin(), row.end(), coeffs_[i++].begin());
+  for (size_t j = 0; j < this->coeffs_.size(); j++)
+    this->coeffs_fixed_[j] = to_fixed_point_section(this->coeffs_[j]);
+}
+
+// direct form 2 transposed, section by section over the whole buffer.
+// state may be longer than coeffs, extra sections are not touched
+static void sos_process(const std::vector<std::array<float, 5>> &coeffs, std::vector<std::array<float, 2>> &state,
+                        float *data, size_t len) {
+  int m = coeffs.size();
+  for (int j = 0; j < m; j++) {
+    for (size_t i = 0; i < len; i++) {
+      // y[i] = b0 * x[i] + s0
+      float yi = coeffs[j][0] * data[i] + state[j][0];
+      // s0 = b1 * x[i] - a1 * y[i] + s1
+      state[j][0] = coeffs[j][1] * data[i] - coeffs[j][3] * yi + state[j][1];
+      // s1 = b2 * x[i] - a2 * y[i]
+      state[j][1] = coeffs[j][2] * data[i] - coeffs[j][4] * yi;
+
+      data[i] = yi;
+    }
+  }
+}
+
+static void sos_process(const std::vector<std::array<int32_t, 7>> &coeffs, std::vector<std::array<int32_t, 6>> &state,
+                        int32_t *data, size_t len) {
+  for (size_t j = 0; j < coeffs.size(); j++)
+    for (size_t i = 0; i < len; i++)
+      data[i] = sos_fixed_point_section(coeffs[j], state[j], data[i]);
+}
+
+size_t SOS_Filter::process(float *data, size_t len) {
+  sos_process(this->coeffs_, this->state_, data, len);
+  return len;
+}
+
+float SOS_Filter::get_cost() { return 5.f * this->coeffs_.size(); }
+
+size_t SOS_Filter::process(int32_t *data, size_t len) {
+  sos_process(this->coeffs_fixed_, this->state_fixed_, data, len);
+  return len;
+}
+
+void SOS_Filter::reset() {
+  for (auto &s : this->state_)
+    s = {0.f, 0.f};
+  for (auto &s : this->state_fixed_)
+    s = {};
+}
+
+/* SwitchableSOS_Filter */
+
+void SwitchableSOS_Filter::add_set(const char *name, SOSCoeffs coeffs) {
+  Set set{name, std::move(coeffs), {}};
+  for (auto &c : set.coeffs)
+    set.coeffs_fixed.push_back(to_fixed_point_section(c));
+  size_t sections = std::max(this->state_.size(), set.coeffs.size());
+  this->state_.resize(sections, {});
+  this->state_fixed_.resize(sections, {});
+  // both slots get the full capacity now, so that switching never allocates
+  for (auto &slot : this->slots_) {
+    slot.coeffs.reserve(sections);
+    slot.coeffs_fixed.reserve(sections);
+  }
+  if (this->sets_.empty()) {
+    this->slots_[0] = set;
+    this->sections_ = set.coeffs.size();
+  }
+  this->sets_.push_back(std::move(set));
+}
+
+void SwitchableSOS_Filter::set_reset_state(bool reset_state) { this->reset_state_ = reset_state; }
+void SwitchableSOS_Filter::set_settle_time(uint32_t settle_time) { this->settle_time_ = settle_time; }
+
+bool SwitchableSOS_Filter::select(const std::string &name) {
+  for (auto &set : this->sets_) {
+    if (name == set.name) {
+      ESP_LOGD(TAG, "Switching filter to '%s' (%u sections)", set.name, set.coeffs.size());
+      this->request_(set);
+      return true;
+    }
+  }
+  ESP_LOGW(TAG, "Unknown filter coefficient set '%s'", name.c_str());
+  return false;
+}
+
+bool SwitchableSOS_Filter::set_coeffs(const SOSCoeffs &coeffs) {
+  if (coeffs.size() > this->state_.size()) {
+    ESP_LOGW(TAG, "Filter has at most %u sections, got %u", this->state_.size(), coeffs.size());
+    return false;
+  }
+  Set set{"custom", coeffs, {}};
+  for (auto &c : set.coeffs)
+    set.coeffs_fixed.push_back(to_fixed_point_section(c));
+  ESP_LOGD(TAG, "Switching filter to custom coefficients (%u sections)", coeffs.size());
+  this->request_(set);
+  return true;
+}
+
+void SwitchableSOS_Filter::request_(const Set &set) {
+  // if the previous request is still pending, it is taken back and the same slot is rewritten, otherwise
+  // the DSP task has switched to it and the other slot is free
+  if (!this->pending_.exchange(false, std::memory_order_acq_rel))
+    this->requested_slot_ ^= 1;
+  auto &slot = this->slots_[this->requested_slot_];
+  slot.name = set.name;
+  slot.coeffs.assign(set.coeffs.begin(), set.coeffs.end());
+  slot.coeffs_fixed.assign(set.coeffs_fixed.begin(), set.coeffs_fixed.end());
+  this->sections_ = set.coeffs.size();
+  this->pending_.store(true, std::memory_order_release);
+}
+
+bool SwitchableSOS_Filter::apply_pending(uint32_t &settle_time) {
+  if (!this->pending_.load(std::memory_order_relaxed) || !this->pending_.exchange(false, std::memory_order_acq_rel))
+    return false;
+  size_t previous = this->slots_[this->active_].coeffs.size();
+  this->active_ ^= 1;
+  if (this->reset_state_) {
+    this->reset();
+  } else {
+    // sections that were not used by the previous set have stale state
+    for (size_t j = previous; j < this->state_.size(); j++) {
+      this->state_[j] = {0.f, 0.f};
+      this->state_fixed_[j] = {};
+    }
+  }
+  if (this->settle_time_.has_value())
+    settle_time = *this->settle_time_;
+  return true;
+}
+
+size_t SwitchableSOS_Filter::process(float *data, size_t len) {
+  sos_process(this->slots_[this->active_].coeffs, this->state_, data, len);
+  return len;
+}
+
+size_t SwitchableSOS_Filter::process(int32_t *data, size_t len) {
+  sos_process(this->slots_[this->active_].coeffs_fixed, this->state_fixed_, data, len);
+  return len;
+}
+
+float SwitchableSOS_Filter::get_cost() { return 5.f * this->sections_; }
+
+void SwitchableSOS_Filter::reset() {
+  for (auto &s : this->state_)
+    s = {0.f, 0.f};
+  for (auto &s : this->state_fixed_)
+    s = {};
+}
+
+/* DecimationFilter */
+
+static inline float decimation_output(float acc) { return acc; }
+
+static inline int32_t decimation_output(int64_t acc) {
+  int64_t y = (acc + (int64_t(1) << (FIXED_POINT_COEFF_FRAC_BITS - 1))) >> FIXED_POINT_COEFF_FRAC_BITS;
+  return int32_t(std::min<int64_t>(std::max<int64_t>(y, INT32_MIN), INT32_MAX));
+}
+
+DecimationFilter::DecimationFilter(uint8_t factor, std::initializer_list<float> &&taps) : factor_(factor) {
+  std::vector<float> h(taps);
+  this->delay_ = h.size() / 2;
+  this->center_tap_ = h[this->delay_];
+  this->center_tap_fixed_ = to_fixed_point(this->center_tap_, FIXED_POINT_COEFF_FRAC_BITS);
+  for (size_t k = 1; k <= this->delay_; k++) {
+    float tap = h[this->delay_ + k];
+    if (tap == 0.f)
+      continue;
+    this->offsets_.push_back(k);
+    this->taps_.push_back(tap);
+    this->taps_fixed_.push_back(to_fixed_point(tap, FIXED_POINT_COEFF_FRAC_BITS));
+  }
+  this->buffer_.resize(2 * this->delay_ + CHUNK_SIZE);
+  this->buffer_fixed_.resize(2 * this->delay_ + CHUNK_SIZE);
+  this->reset();
+}
+
+size_t DecimationFilter::process(float *data, size_t len) {
+  return this->process_<float>(data, len, this->buffer_, this->center_tap_, this->taps_);
+}
+
+size_t DecimationFilter::process(int32_t *data, size_t len) {
+  return this->process_<int64_t>(data, len, this->buffer_fixed_, this->center_tap_fixed_, this->taps_fixed_);
+}
+
+uint8_t DecimationFilter::get_decimation_factor() { return this->factor_; }
+// one multiplication per folded pair of taps and the center one, only for kept samples
+float DecimationFilter::get_cost() { return float(this->taps_.size() + 1) / this->factor_; }
+
+template<typename Acc, typename T>
+size_t DecimationFilter::process_(T *data, size_t len, std::vector<T> &buffer, T center_tap,
+                                  const std::vector<T> &taps) {
+  const size_t history = 2 * this->delay_;
+  const size_t m = taps.size();
+  size_t out = 0;
+  for (size_t start = 0; start < len; start += CHUNK_SIZE) {
+    size_t n = std::min(CHUNK_SIZE, len - start);
+    std::copy(data + start, data + start + n, buffer.begin() + history);
+    size_t i = this->phase_;
+    for (; i < n; i += this->factor_) {
+      // i-th new sample is the last one of the window, so the center is delay_ samples before it
+      const T *x = buffer.data() + i + this->delay_;
+      Acc acc = Acc(center_tap) * x[0];
+      for (size_t j = 0; j < m; j++) {
+        size_t k = this->offsets_[j];
+        acc += Acc(taps[j]) * (Acc(x[-ptrdiff_t(k)]) + x[k]);
+      }
+      // output index never exceeds the index of consumed input
+      data[out++] = decimation_output(acc);
+    }
+    this->phase_ = i - n;
+    std::copy(buffer.begin() + n, buffer.begin() + n + history, buffer.begin());
+  }
+  return out;
+}
+
+void DecimationFilter::reset() {
+  std::fill(this->buffer_.begin(), this->buffer_.end(), 0.f);
+  std::fill(this->buffer_fixed_.begin(), this->buffer_fixed_.end(), 0);
+  this->phase_ = 0;
 }
 }  // namespace sound_level_meter
 }  // namespace esphome
\ No newline at end of file
@@ -1,23 +1,369 @@
 #pragma once
 
 #include "esp_timer.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <mutex>
 #include <condition_variable>
 #include <algorithm>
-#include <queue>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <type_traits>
 #include "esphome/core/component.h"
 #include "esphome/core/automation.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
 #include "esphome/components/sensor/sensor.h"
+#ifdef USE_TIME
+#include "esphome/components/time/real_time_clock.h"
+#endif
+#ifndef USE_HOST
 #include "esphome/components/i2s/i2s.h"
+#endif
 
 namespace esphome {
 namespace sound_level_meter {
 class SensorGroup;
 class SoundLevelMeterSensor;
 class Filter;
+class FilterBank;
+
+// Fixed capacity lock-free ring buffer, safe to use from exactly one producer
+// and one consumer thread. Memory is allocated once in init()
+template<typename T> class SPSCQueue {
+ public:
+  void init(size_t capacity) { this->items_.resize(capacity + 1); }
+  size_t capacity() const { return this->items_.size() - 1; }
+
+  bool push(const T &item) {
+    size_t tail = this->tail_.load(std::memory_order_relaxed);
+    size_t next = this->next_(tail);
+    if (next == this->head_.load(std::memory_order_acquire))
+      return false;
+    this->items_[tail] = item;
+    this->tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    size_t head = this->head_.load(std::memory_order_relaxed);
+    if (head == this->tail_.load(std::memory_order_acquire))
+      return false;
+    item = this->items_[head];
+    this->head_.store(this->next_(head), std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    size_t head = this->head_.load(std::memory_order_acquire);
+    size_t tail = this->tail_.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : tail + this->items_.size() - head;
+  }
+
+ protected:
+  std::vector<T> items_;
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> tail_{0};
+
+  size_t next_(size_t i) const { return i + 1 == this->items_.size() ? 0 : i + 1; }
+};
+
+// Sum of the last N values pushed, O(1) per push with memory for N values
+class SlidingSum {
+ public:
+  void init(size_t capacity);
+  void push(float value);
+  // number of values in the window, less than capacity until it fills up
+  size_t size() const { return this->size_; }
+  double sum() const { return this->sum_; }
+  void clear();
+
+ protected:
+  std::vector<float> values_;
+  size_t next_{0};
+  size_t size_{0};
+  double sum_{0.};
+};
+
+// Max (with Compare = std::greater) or min (std::less) of the last N values pushed. Monotonic deque:
+// values that can never become the extremum are dropped on push, so it's amortized O(1) per push
+template<typename Compare> class SlidingExtremum {
+ public:
+  void init(size_t capacity) {
+    this->entries_.resize(capacity);
+    this->clear();
+  }
+
+  void push(float value) {
+    size_t capacity = this->entries_.size();
+    while (this->size_ > 0 && !Compare()(this->back_().value, value))
+      this->size_--;
+    if (this->size_ > 0 && this->index_ - this->entries_[this->head_].index >= capacity) {
+      this->head_ = (this->head_ + 1) % capacity;
+      this->size_--;
+    }
+    this->entries_[(this->head_ + this->size_++) % capacity] = {this->index_++, value};
+  }
+
+  float get() const { return this->size_ > 0 ? this->entries_[this->head_].value : NAN; }
+
+  void clear() {
+    this->head_ = 0;
+    this->size_ = 0;
+    this->index_ = 0;
+  }
+
+ protected:
+  struct Entry {
+    uint32_t index;
+    float value;
+  };
+  std::vector<Entry> entries_;
+  size_t head_{0};
+  size_t size_{0};
+  uint32_t index_{0};
+
+  const Entry &back_() const { return this->entries_[(this->head_ + this->size_ - 1) % this->entries_.size()]; }
+};
+
+// Fixed point processing works on int32 samples where full scale (1.0) is 2^FIXED_POINT_FRAC_BITS,
+// leaving a few bits of headroom for filter gain. SOS coefficients are stored with
+// FIXED_POINT_COEFF_FRAC_BITS fractional bits, so their magnitude must be less than 4
+static const uint8_t FIXED_POINT_FRAC_BITS = 28;
+static const uint8_t FIXED_POINT_COEFF_FRAC_BITS = 29;
+// squares are shifted right before accumulation, so that sums over long windows fit into 64 bits
+static const uint8_t FIXED_POINT_SQUARE_SHIFT = 16;
+
+int32_t to_fixed_point(float value, uint8_t frac_bits);
+
+// Per sample type operations used by sensors, so the same accumulation code serves both
+// float and fixed point pipelines. energy_t is the type for sums of squares within a window,
+// to_energy() converts it into float domain units (1.0 is full scale squared)
+template<typename T> struct SampleTraits;
+
+template<> struct SampleTraits<float> {
+  using energy_t = float;
+  using amplitude_t = float;
+  static energy_t square(float x) { return x * x; }
+  static amplitude_t abs(float x) { return std::abs(x); }
+  static float to_energy(energy_t e) { return e; }
+  static float to_amplitude(amplitude_t a) { return a; }
+};
+
+template<> struct SampleTraits<int32_t> {
+  using energy_t = uint64_t;
+  using amplitude_t = uint32_t;
+  static energy_t square(int32_t x) { return uint64_t(int64_t(x) * x) >> FIXED_POINT_SQUARE_SHIFT; }
+  static amplitude_t abs(int32_t x) { return x < 0 ? -uint32_t(x) : x; }
+  static double to_energy(energy_t e) {
+    return std::ldexp(double(e), FIXED_POINT_SQUARE_SHIFT - 2 * FIXED_POINT_FRAC_BITS);
+  }
+  static float to_amplitude(amplitude_t a) { return std::ldexp(float(a), -FIXED_POINT_FRAC_BITS); }
+};
+
+// Sums over consecutive samples processed by a sensor group in one go. Segments never cross window
+// or update interval boundaries of any sensor in the group, so sensors only add them up
+template<typename T> struct SampleSegment {
+  typename SampleTraits<T>::energy_t energy;
+  typename SampleTraits<T>::amplitude_t peak;
+  uint32_t len;
+};
+
+// Block of samples passed from the reader task to the DSP task,
+// block without data only signals that the meter was turned off
+struct AudioBlock {
+  void *data;
+  size_t len;
+  // meter was turned off/on since the previous block, so its state must be reset first
+  bool reset;
+};
+
+struct PublishRecord {
+  sensor::Sensor *sensor;
+  float state;
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  // esp_timer_get_time() when the value was computed, to measure publish latency
+  uint32_t enqueued_at;
+#endif
+};
+
+// Threshold crossing detected by the audio task, passed to the main loop ahead of regular values
+struct ThresholdRecord {
+  SoundLevelMeterSensor *sensor;
+  // level in dB that crossed the threshold
+  float level;
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  // esp_timer_get_time() when the crossing was detected, to measure threshold latency
+  uint32_t detected_at;
+#endif
+};
+
+// Ring buffer of the last seconds of input audio as int16, written by the reader task. freeze() keeps it
+// after post trigger samples until release(), so that it could be read as a WAV file
+class SnapshotBuffer {
+ public:
+  bool init(uint32_t sample_rate, size_t capacity, size_t post_trigger);
+  size_t get_capacity();
+  // called from the reader task
+  template<typename T> void write(const T *data, size_t len);
+  // drops recorded samples unless frozen, e.g. after turning the meter on
+  void clear();
+  // called from the main loop
+  void freeze();
+  bool is_frozen();
+  void release();
+  // mono 16 bit PCM WAV file with samples in chronological order, it is read in chunks straight
+  // from the ring, so that it is never copied as a whole. Valid only while frozen
+  size_t get_wav_size();
+  size_t read_wav(size_t offset, uint8_t *data, size_t len);
+
+ protected:
+  int16_t *samples_{nullptr};
+  uint32_t sample_rate_{0};
+  size_t capacity_{0};
+  size_t post_trigger_{0};
+  // position of the next sample to write and number of recorded samples
+  size_t head_{0};
+  size_t count_{0};
+  // writer state of the requested freeze: samples left to record
+  bool post_trigger_started_{false};
+  size_t post_trigger_left_{0};
+  std::atomic<bool> freeze_pending_{false};
+  std::atomic<bool> frozen_{false};
+};
+
+#ifdef USE_SOUND_LEVEL_METER_TAP
+// Streams output of a group's filters to a TCP client as float WAV. The audio task only copies blocks into
+// a bounded pool (dropping them when it is full), a separate task does the sending
+class PcmTap {
+ public:
+  void set_port(uint16_t port);
+  void set_buffer_count(uint8_t buffer_count);
+  // allocates buffers of block_size samples and starts the sender task
+  bool setup(float sample_rate, size_t block_size);
+  void dump_config(const char *prefix);
+  // called by the DSP task, does nothing while no client is connected
+  template<typename T> void write(const T *data, size_t len);
+  bool is_connected();
+  // counters since start, over all connections
+  uint32_t get_sent_blocks();
+  uint32_t get_dropped_blocks();
+  // blocks queued or being sent
+  size_t get_pending_blocks();
+
+ protected:
+  struct Block {
+    float *data;
+    size_t len;
+  };
+  uint16_t port_{0};
+  uint8_t buffer_count_{8};
+  uint32_t sample_rate_{0};
+  size_t block_size_{0};
+  std::vector<float *> buffers_;
+  SPSCQueue<Block> filled_blocks_;
+  SPSCQueue<float *> free_buffers_;
+  TaskHandle_t task_handle_{nullptr};
+  std::atomic<bool> connected_{false};
+  std::atomic<uint32_t> sent_blocks_{0};
+  std::atomic<uint32_t> dropped_blocks_{0};
+
+  static void sender_task(void *param);
+  int listen_();
+  void serve_(int client);
+  // returns blocks left from the previous client to the pool
+  void discard_blocks_();
+};
+#endif
+
+// Value published by a sensor, as exported from LevelHistory
+struct HistoryRecord {
+  sensor::Sensor *sensor;
+  float value;
+  // time since the value was published, ms
+  uint32_t age;
+};
+
+// Values published by selected sensors, delta encoded into blocks of a ring buffer (the oldest block is
+// overwritten), so that they could be exported after connection is restored. Used only from the main loop
+class LevelHistory {
+ public:
+  // up to 255 sensors, their values are recorded on every publish
+  bool init(size_t size, const std::vector<sensor::Sensor *> &sensors);
+  void append(uint8_t index, float value, uint32_t now);
+  // export continues from where the previous one ended, so only records not exported yet are exported
+  void start_export();
+  bool is_exporting();
+  // decodes up to max next records, export ends when there are no more
+  void export_batch(std::vector<HistoryRecord> &records, size_t max, uint32_t now);
+  size_t get_size();
+  // records and their encoded size since start
+  uint32_t get_record_count();
+  uint64_t get_encoded_size();
+  // records overwritten before they were exported
+  uint32_t get_lost_records();
+
+ protected:
+  // position in the record stream, with the state needed to decode the next record
+  struct Cursor {
+    uint32_t block;
+    // 0 if the block is not started yet
+    size_t offset;
+    // records before offset within the block
+    uint16_t index;
+    // time of the previous record since the block start, in 10ms units
+    uint32_t time;
+    // previous value of every sensor in 0.01dB
+    std::vector<int32_t> values;
+  };
+  uint8_t *data_{nullptr};
+  uint32_t block_count_{0};
+  std::vector<sensor::Sensor *> sensors_;
+  Cursor writer_{};
+  Cursor reader_{};
+  bool exporting_{false};
+  uint32_t record_count_{0};
+  uint64_t encoded_size_{0};
+  uint32_t lost_records_{0};
+
+  uint8_t *block_(uint32_t block);
+  // the first block not overwritten yet
+  uint32_t oldest_block_();
+  void start_block_(Cursor &cursor, uint32_t block);
+};
+
+// Provides audio samples for processing. On device it is I2S microphone,
+// on host it could be e.g. a recorded audio file
+class SampleSource {
+ public:
+  virtual uint32_t get_sample_rate() = 0;
+  virtual bool read_samples(float *data, size_t num_samples, size_t *samples_read) = 0;
+  // samples in fixed point format, see FIXED_POINT_FRAC_BITS
+  virtual bool read_samples(int32_t *data, size_t num_samples, size_t *samples_read) = 0;
+  // number of samples lost before they could be read (e.g. I2S DMA overflows), since start
+  virtual uint32_t get_dropped_samples() { return 0; }
+};
+
+#ifndef USE_HOST
+class I2SSampleSource : public SampleSource {
+ public:
+  explicit I2SSampleSource(i2s::I2SComponent *i2s) : i2s_(i2s) {}
+  virtual uint32_t get_sample_rate() override;
+  virtual bool read_samples(float *data, size_t num_samples, size_t *samples_read) override;
+  virtual bool read_samples(int32_t *data, size_t num_samples, size_t *samples_read) override;
+  virtual uint32_t get_dropped_samples() override;
+
+ protected:
+  i2s::I2SComponent *i2s_;
+};
+#endif
 
 class SoundLevelMeter : public Component {
   friend class SoundLevelMeterSensor;
+  friend class SensorGroup;
 
  public:
   void set_update_interval(uint32_t update_interval);
@@ -25,18 +371,60 @@ class SoundLevelMeter : public Component {
   void set_buffer_size(uint32_t buffer_size);
   uint32_t get_buffer_size();
   uint32_t get_sample_rate();
+#ifndef USE_HOST
   void set_i2s(i2s::I2SComponent *i2s);
+#endif
+  void set_source(SampleSource *source);
   void add_group(SensorGroup *group);
   void set_warmup_interval(uint32_t warmup_interval);
+  uint32_t get_warmup_interval();
   void set_task_stack_size(uint32_t task_stack_size);
   void set_task_priority(uint8_t task_priority);
   void set_task_core(uint8_t task_core);
+  void set_reader_task_priority(uint8_t reader_task_priority);
+  void set_reader_task_core(uint8_t reader_task_core);
+  void set_buffer_count(uint8_t buffer_count);
+  void set_worker_count(uint8_t worker_count);
   void set_mic_sensitivity(optional<float> mic_sensitivity);
   optional<float> get_mic_sensitivity();
   void set_mic_sensitivity_ref(optional<float> mic_sensitivity_ref);
   optional<float> get_mic_sensitivity_ref();
   void set_offset(optional<float> offset);
   optional<float> get_offset();
+  void set_use_psram(bool use_psram);
+  void set_fixed_point(bool fixed_point);
+  void set_publish_queue_size(uint32_t publish_queue_size);
+  uint32_t get_publish_queue_high_water_mark();
+  uint32_t get_dropped_publishes();
+  uint32_t get_block_queue_size();
+  uint32_t get_block_queue_high_water_mark();
+  uint32_t get_dropped_blocks();
+  // samples lost by the source (I2S DMA overflows) or dropped because processing couldn't keep up,
+  // losses while turned off are not counted
+  uint32_t get_dropped_samples();
+  void set_dropped_samples_sensor(sensor::Sensor *dropped_samples_sensor);
+  // percent of samples lost during update interval, above which on_sample_loss callbacks are called
+  void set_sample_loss_threshold(float sample_loss_threshold);
+  void add_on_sample_loss_callback(std::function<void(float)> &&callback);
+  // length of the input audio snapshot (0 to disable) and how much of it is recorded after take_snapshot()
+  void set_snapshot_duration(uint32_t snapshot_duration);
+  void set_snapshot_post_trigger(uint32_t snapshot_post_trigger);
+  // nullptr if snapshot is disabled or its buffer couldn't be allocated
+  SnapshotBuffer *get_snapshot();
+  // freezes snapshot after post trigger interval, then on_snapshot callbacks are called
+  // and it stays frozen until release_snapshot()
+  void take_snapshot();
+  void release_snapshot();
+  void add_on_snapshot_callback(std::function<void()> &&callback);
+  // size of the history buffer in bytes (0 to disable) and sensors recorded into it
+  void set_history_size(uint32_t history_size);
+  void add_history_sensor(sensor::Sensor *sensor);
+  // max number of records passed to on_history_export callbacks at once, one batch per loop()
+  void set_history_batch_size(uint16_t history_batch_size);
+  // nullptr if history is disabled or its buffer couldn't be allocated
+  LevelHistory *get_history();
+  void export_history();
+  void add_on_history_export_callback(std::function<void(std::vector<HistoryRecord>)> &&callback);
   virtual void setup() override;
   virtual void loop() override;
   virtual void dump_config() override;
@@ -44,30 +432,157 @@ class SoundLevelMeter : public Component {
   void turn_off();
   void toggle();
   bool is_on();
+  // runs all groups over a single buffer, normally called from the DSP task.
+  // With multiple workers independent groups are processed in parallel and it returns when all are done
+  void process(float *data, size_t len);
+  void process(int32_t *data, size_t len);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  void set_cpu_load_sensor(sensor::Sensor *cpu_load_sensor);
+  void set_i2s_read_wait_sensor(sensor::Sensor *i2s_read_wait_sensor);
+  void set_publish_latency_sensor(sensor::Sensor *publish_latency_sensor);
+  void set_threshold_latency_sensor(sensor::Sensor *threshold_latency_sensor);
+#endif
+  // logs processing time of every filter, sensor, sensor kernel and group accumulated since the previous dump,
+  // does nothing unless built with profiling enabled
+  void dump_profile();
 
  protected:
-  i2s::I2SComponent *i2s_{nullptr};
+  SampleSource *source_{nullptr};
   std::vector<SensorGroup *> groups_;
+  // top level of the execution tree, see SensorGroup::share_filters()
+  std::vector<SensorGroup *> exec_groups_;
   size_t buffer_size_{256};
   uint32_t warmup_interval_{500};
   uint32_t task_stack_size_{1024};
   uint8_t task_priority_{1};
   uint8_t task_core_{1};
+  uint8_t reader_task_priority_{3};
+  uint8_t reader_task_core_{1};
   optional<float> mic_sensitivity_{};
   optional<float> mic_sensitivity_ref_{};
   optional<float> offset_{};
-  std::queue<std::function<void()>> defer_queue_;
-  std::mutex defer_mutex_;
+  bool use_psram_{false};
+  // all audio buffers are allocated once in setup(): buffer_count_ for incoming samples
+  // and one scratch buffer per level of nested groups with filters
+  // buffers are used either as float or int32 depending on fixed_point_ setting
+  bool fixed_point_{false};
+  uint8_t buffer_count_{2};
+  std::vector<void *> buffers_;
+  // serial_depth_ buffers for serial_groups_ followed by scratch_depth_ buffers for each worker
+  size_t serial_depth_{0};
+  size_t scratch_depth_{0};
+  std::vector<float *> scratch_;
+  std::vector<int32_t *> scratch_fixed_;
+  // reader task only moves I2S data into free buffers and hands them over to the DSP task
+  // without copying, processed buffers are returned back through free_buffers_
+  SPSCQueue<AudioBlock> filled_blocks_;
+  SPSCQueue<void *> free_buffers_;
+  std::atomic<uint32_t> block_queue_high_water_mark_{0};
+  std::atomic<uint32_t> dropped_blocks_{0};
+  uint32_t reported_dropped_blocks_{0};
+  uint32_t reported_lost_records_{0};
+  // sample loss accounting: samples in dropped blocks, samples dropped by the source during warmup
+  // or while turned off and processed samples, the latter is used to check the loss every update interval
+  std::atomic<uint32_t> dropped_block_samples_{0};
+  std::atomic<uint32_t> source_dropped_samples_ignored_{0};
+  std::atomic<uint32_t> processed_samples_{0};
+  uint32_t loss_check_processed_samples_{0};
+  uint32_t loss_check_dropped_samples_{0};
+  float sample_loss_threshold_{0};
+  sensor::Sensor *dropped_samples_sensor_{nullptr};
+  CallbackManager<void(float)> sample_loss_callback_{};
+  uint32_t snapshot_duration_{0};
+  uint32_t snapshot_post_trigger_{0};
+  std::unique_ptr<SnapshotBuffer> snapshot_;
+  bool snapshot_reported_{false};
+  CallbackManager<void()> snapshot_callback_{};
+  uint32_t history_size_{0};
+  uint16_t history_batch_size_{32};
+  std::vector<sensor::Sensor *> history_sensors_;
+  std::unique_ptr<LevelHistory> history_;
+  std::vector<HistoryRecord> history_batch_;
+  CallbackManager<void(std::vector<HistoryRecord>)> history_export_callback_{};
+  TaskHandle_t dsp_task_handle_{nullptr};
+
+  // Groups on the same level of the execution tree are independent of each other, so they could be distributed
+  // between workers. These are top level groups, or nested ones if there is a single top level group
+  // (e.g. mic equalization followed by different weightings) - then the chain of single groups above
+  // them (serial_groups_) is processed first. Worker 0 is the task calling process(), others are separate tasks
+  std::vector<SensorGroup *> serial_groups_;
+  std::vector<SensorGroup *> parallel_groups_;
+  struct Worker {
+    SoundLevelMeter *parent;
+    uint8_t index;
+    TaskHandle_t task;
+    std::vector<size_t> groups;
+  };
+  uint8_t worker_count_{1};
+  std::vector<Worker> workers_;
+  // smoothed processing time of each parallel group per block (us), used to balance workers
+  std::vector<float> group_cost_;
+  std::vector<size_t> balance_order_;
+  std::vector<float> balance_load_;
+  uint32_t blocks_since_balance_{0};
+  // block being processed by workers
+  const void *job_data_{nullptr};
+  size_t job_len_{0};
+  bool job_fixed_point_{false};
+  std::atomic<uint8_t> pending_workers_{0};
+  TaskHandle_t join_task_{nullptr};
+  // esphome's sensors are not thread safe, so values computed in the audio task
+  // are passed through these queues (one per worker) and published from the main loop
+  std::unique_ptr<SPSCQueue<PublishRecord>[]> publish_queues_;
+  uint32_t publish_queue_size_{64};
+  std::atomic<uint32_t> publish_queue_high_water_mark_{0};
+  std::atomic<uint32_t> dropped_publishes_{0};
+  // threshold crossings go through separate small queues, which are drained first,
+  // so they don't wait behind a backlog of regular values
+  std::unique_ptr<SPSCQueue<ThresholdRecord>[]> threshold_queues_;
+  uint32_t reported_dropped_publishes_{0};
   uint32_t update_interval_{60000};
   bool is_on_{true};
+  // turn_on/turn_off are called from the main loop, but reset is performed by the DSP
+  // task in order with audio blocks, so that sensors are only touched from one thread
+  bool reset_pending_{false};
   std::mutex on_mutex_;
   std::condition_variable on_cv_;
+  // some group was turned on/off, states of groups are updated by the DSP task before the next block
+  std::atomic<bool> group_states_changed_{false};
 
-  static void task(void *param);
-  // epshome's scheduler is not thred safe, so we have to use custom thread safe implementation
-  // to execute sensor updates in main loop
-  void defer(std::function<void()> &&f);
+  static void reader_task(void *param);
+  static void dsp_task(void *param);
+  static void worker_task(void *param);
+  bool read_block(void *buffer, size_t *samples_read);
+  template<typename T> T *const *get_scratch(size_t offset);
+  template<typename T> void process_(T *data, size_t len);
+  template<typename T> void process_parallel_(T *data, size_t len);
+  template<typename T> void process_worker_(size_t worker, const T *data, size_t len);
+  void balance_workers();
+  size_t get_audio_memory_size();
+  void enqueue_publish(uint8_t worker, sensor::Sensor *sensor, float state);
+  void enqueue_threshold(uint8_t worker, SoundLevelMeterSensor *sensor, float level);
   void reset();
+  void check_sample_loss();
+
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  sensor::Sensor *cpu_load_sensor_{nullptr};
+  sensor::Sensor *i2s_read_wait_sensor_{nullptr};
+  sensor::Sensor *publish_latency_sensor_{nullptr};
+  sensor::Sensor *threshold_latency_sensor_{nullptr};
+  // time the reader task spent waiting for I2S data since the last cpu load update, us
+  std::atomic<uint32_t> read_wait_time_{0};
+  // dump is requested from the main loop, but performed between blocks by the DSP task
+  std::atomic<bool> profile_dump_pending_{false};
+  // time spent in process() and number of processed samples since the last dump
+  uint64_t profile_time_{0};
+  uint64_t profile_samples_{0};
+  uint32_t max_publish_latency_{0};
+  uint32_t max_threshold_latency_{0};
+  uint32_t threshold_latency_count_{0};
+  uint32_t publish_latency_start_{0};
+
+  void log_profile();
+#endif
 };
 
 class SensorGroup {
@@ -76,15 +591,175 @@ class SensorGroup {
   void add_sensor(SoundLevelMeterSensor *sensor);
   void add_group(SensorGroup *group);
   void add_filter(Filter *filter);
-  void process(std::vector<float> &buffer);
+  void set_filter_bank(FilterBank *filter_bank);
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  void set_tap(PcmTap *tap);
+#endif
+  // propagates sample rate of the data this group gets down to its sensors and subgroups
+  void set_sample_rate(float sample_rate);
+  // Builds the execution tree for groups and all nested groups: siblings whose filters start with the same
+  // Filter objects (codegen passes one object for identical filters) are put under a group that exists only
+  // there and runs those filters once for all of them. Returns the new list for groups, the tree of the user
+  // (shown by dump_config, turned on/off) stays as it is
+  static std::vector<SensorGroup *> share_filters(const std::vector<SensorGroup *> &groups);
+  // flattens the execution tree below this group into the execution plan, recursively for all nested groups
+  void build_plan();
+  // runs the execution plan. scratch points to the preallocated buffers available to this group
+  // and its subgroups: if the group has filters it takes the first one and passes the rest down
+  template<typename T> void process(const T *data, size_t len, T *const *scratch);
+  // runs only filters (in place of filtered buffer) and sensors of this group, but not nested groups,
+  // returns data for nested groups, len is updated if filters reduce sample rate.
+  // Sensors don't see samples: squares and peaks are computed once for all of them, block is split
+  // at their window and update boundaries, and each sensor gets sums over the resulting segments
+  template<typename T> const T *process_own(const T *data, size_t &len, T *filtered);
+  // number of scratch buffers needed to process this group
+  size_t get_scratch_depth();
+  // index of worker processing this group, selects publish queue of its sensors
+  void set_worker(uint8_t worker);
+  // turns this group with all nested groups on/off, called from the main loop and applied
+  // by the DSP task before the next block
+  void turn_on();
+  void turn_off();
+  void toggle();
+  bool is_on();
+  // Called by the DSP task. Group is active if it is on (with all its ancestors) and there is anything
+  // to report in its subtree, inactive groups are skipped with all nested groups. Groups that become
+  // inactive reset their filters and sensors (publishing NAN), groups that become active run filters
+  // without sensors for warmup interval, so that the filter transient is not measured. initial only
+  // sets the state, without resets and warmup. Returns whether the group is active
+  bool update_state(bool parent_on, bool initial);
+  // Called from the main loop: updates whether own sensors are needed (see SoundLevelMeterSensor::is_needed()),
+  // returns whether it changed anywhere in the subtree, so that the DSP task updates states
+  bool update_needed();
+  bool is_active();
+  const std::vector<SensorGroup *> &get_exec_groups();
+  // whether the group runs any filters itself, the ones shared with siblings are not counted
+  bool has_filters();
+  bool has_filter_bank();
   void dump_config(const char *prefix);
+  // logs steps of the execution plan with estimated cost of each for block of len samples, returns total cost
+  float dump_plan(const char *prefix, float len);
+  // estimated multiply-accumulate operations of own filters and sensors, len is updated like in process_own()
+  float get_own_cost(float &len);
   void reset();
+  // Called by the DSP task when own filters switched coefficients: sensors of this group and active nested
+  // groups start over (publishing NAN, so no value mixes two responses) and skip settle_time ms of audio
+  void restart(uint32_t settle_time);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  // processing time of this group with subgroups since the last reset_profile(), us
+  uint64_t get_profile_time();
+  // audio_time is duration of processed audio in us, stages are logged as percent of it
+  void dump_profile(const char *prefix, float audio_time);
+  void reset_profile();
+  // time of filters run by shared groups among exec_groups, which is not counted in any group of the user
+  static uint64_t get_shared_profile_time(const std::vector<SensorGroup *> &exec_groups);
+#endif
 
  protected:
   SoundLevelMeter *parent_{nullptr};
   std::vector<SensorGroup *> groups_;
+  // nested groups in the execution tree, where siblings with shared filters are under a group with them
+  std::vector<SensorGroup *> exec_groups_;
   std::vector<SoundLevelMeterSensor *> sensors_;
   std::vector<Filter *> filters_;
+  // number of leading filters run by a shared group above this one, own processing starts after them
+  uint8_t first_filter_{0};
+  // whether this group exists only in the execution tree
+  bool shared_{false};
+  FilterBank *filter_bank_{nullptr};
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  PcmTap *tap_{nullptr};
+#endif
+  // what sensors need from segments, so that the kernel skips squares or peaks if nobody uses them
+  bool needs_energy_{false};
+  bool needs_peak_{false};
+  std::atomic<bool> is_on_{true};
+  bool active_{true};
+  // whether any own sensor is needed or there is a tap
+  std::atomic<bool> needed_{true};
+  // input sample rate, to convert settle time
+  float sample_rate_{0};
+  // samples (at the input rate of the group) to process without sensors after becoming active
+  uint32_t settle_samples_{0};
+  uint32_t settle_left_{0};
+  // The tree below this group flattened in depth first order, so that processing is a single loop.
+  // Every step runs own filters and sensors of one group (or a filter bank): it reads the slot written
+  // by its nearest ancestor with filters and, if it has filters itself, writes to its own slot.
+  // Slot 0 is the input of this group, slot n > 0 is n-th scratch buffer. Siblings are processed only
+  // after the whole subtree of the previous one, so deeper slots could be reused
+  struct PlanStep {
+    SensorGroup *group;
+    FilterBank *filter_bank;
+    uint8_t input;
+    uint8_t output;
+    // index of the first step after the subtree of this group, where to go if the group is inactive
+    uint16_t next;
+  };
+  std::vector<PlanStep> plan_;
+  std::vector<const void *> slot_data_;
+  std::vector<size_t> slot_len_;
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  // processing time of each filter and each sensor, us. kernel time is the shared sum of squares / peak
+  // computation over each segment, it is not attributed to any single sensor
+  std::vector<uint64_t> filter_time_;
+  std::vector<uint64_t> sensor_time_;
+  uint64_t kernel_time_{0};
+#endif
+
+  static std::vector<SensorGroup *> share_filters_(const std::vector<SensorGroup *> &groups, uint8_t shared);
+  void add_plan_steps_(std::vector<PlanStep> &plan, uint8_t input, uint8_t depth);
+  template<typename T> void process_sensors_(const T *data, size_t len);
+  // resets only own filters and sensors, not nested groups
+  void reset_own_();
+};
+
+// Splits signal into (fractional) octave bands, each band is a group with a band pass filter and sensors.
+// Lower bands are processed at lower sample rates: signal goes through a chain of decimators
+// (anti-aliasing low pass filter + dropping every other sample), and each band is attached to the level
+// of the chain with the lowest sample rate that is still high enough for it. Thus the whole bank costs
+// about as much as processing of the highest octave at the full rate.
+class FilterBank {
+ public:
+  // low pass filter applied before going to the next level, one per level except the first one
+  void add_decimator(Filter *filter);
+  // level 0 is the input sample rate, level n is 2^n times lower
+  void add_band(const char *name, uint8_t level, SensorGroup *band);
+  // first scratch buffer holds decimated signal, the rest are passed to bands
+  template<typename T> void process(const T *data, size_t len, T *const *scratch);
+  size_t get_scratch_depth();
+  void set_sample_rate(float sample_rate);
+  void set_worker(uint8_t worker);
+  // updates states of bands, returns whether any of them is active. Inactive bands are skipped, and
+  // so are decimation levels above the highest active band
+  bool update_state(bool parent_on, bool initial);
+  bool update_needed();
+  void build_plan();
+  void dump_config(const char *prefix);
+  float dump_plan(const char *prefix, float len);
+  void reset();
+  void restart(uint32_t settle_time);
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  uint64_t get_profile_time();
+  void dump_profile(const char *prefix, float audio_time);
+  void reset_profile();
+#endif
+
+ protected:
+  struct Band {
+    const char *name;
+    uint8_t level;
+    SensorGroup *group;
+  };
+  std::vector<Filter *> decimators_;
+  // bands sorted by level
+  std::vector<Band> bands_;
+  // parity of the first sample of the next block at each level, so that decimation
+  // doesn't depend on block boundaries
+  std::vector<uint8_t> phases_;
+  float sample_rate_{0};
+#ifdef USE_SOUND_LEVEL_METER_PROFILING
+  std::vector<uint64_t> decimator_time_;
+#endif
 };
 
 class SoundLevelMeterSensor : public sensor::Sensor {
@@ -93,89 +768,499 @@ class SoundLevelMeterSensor : public sensor::Sensor {
  public:
   void set_parent(SoundLevelMeter *parent);
   void set_update_interval(uint32_t update_interval);
-  virtual void process(std::vector<float> &buffer) = 0;
+  // converts intervals to number of samples, sensors inside filter banks
+  // get data at lower sample rate than the meter
+  virtual void set_sample_rate(float sample_rate);
+  // number of samples until the next window or update interval boundary, segments
+  // passed to add_segment() are never longer than that
+  virtual uint32_t get_samples_to_boundary() = 0;
+  virtual void add_segment(const SampleSegment<float> &segment) = 0;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) = 0;
+  // whether sensor uses sum of squares and/or peak of segments
+  virtual bool needs_energy() { return true; }
+  virtual bool needs_peak() { return false; }
   void defer_publish_state(float state);
+  // Threshold is checked by the audio task on every level the sensor computes internally: peak of each
+  // block for peak, time weighted level every ~1ms for time_weighted, level of each window for max, min
+  // and percentile, and of each block for eq. It triggers once the level stays at or above threshold for
+  // threshold duration, and is re-armed when the level falls below threshold minus hysteresis
+  void set_threshold(float threshold);
+  void set_threshold_duration(uint32_t threshold_duration);
+  void set_threshold_hysteresis(float threshold_hysteresis);
+  // whether the level is also published as sensor state right away, out of the update interval
+  void set_publish_on_threshold(bool publish_on_threshold);
+  void add_on_threshold_callback(std::function<void(float)> &&callback);
+  // called from the main loop
+  void publish_threshold(float level);
+  // sensor could be read from lambdas (it has an id set in config), so it is computed even if internal
+  void set_referenced(bool referenced);
+  // Whether anything uses the values: the sensor is not internal, is referenced, has a threshold or
+  // state callbacks (automations, history, other sensors). Called from the main loop
+  bool is_needed();
 
  protected:
   SoundLevelMeter *parent_{nullptr};
+  uint32_t update_interval_{0};
   uint32_t update_samples_{0};
+  uint8_t worker_{0};
+  optional<float> threshold_{};
+  uint32_t threshold_duration_{0};
+  float threshold_hysteresis_{0.f};
+  bool publish_on_threshold_{true};
+  bool referenced_{false};
+  // threshold and re-arm levels converted to mean square (or amplitude for peak) in full scale units,
+  // so that the audio task compares them without log10
+  float threshold_level_{INFINITY};
+  float rearm_level_{INFINITY};
+  uint32_t threshold_samples_{0};
+  uint32_t above_threshold_samples_{0};
+  bool threshold_triggered_{false};
+  CallbackManager<void(float)> threshold_callback_{};
   float adjust_dB(float dB, bool is_rms = true);
+  // level is mean square, or amplitude for sensors not using energy, len is the number of samples it covers
+  void check_threshold_(float level, uint32_t len);
+  void reset_threshold_();
 
   virtual void reset() = 0;
 };
 
 class SoundLevelMeterSensorEq : public SoundLevelMeterSensor {
  public:
-  virtual void process(std::vector<float> &buffer) override;
+  // if set, Leq is calculated over this period (rounded to update intervals) ending at each update
+  void set_sliding_window(uint32_t sliding_window);
+  virtual void set_sample_rate(float sample_rate) override;
+  virtual uint32_t get_samples_to_boundary() override;
+  virtual void add_segment(const SampleSegment<float> &segment) override;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) override;
 
  protected:
   double sum_{0.};
   uint32_t count_{0};
+  uint32_t sliding_window_{0};
+  // mean squares of the last update intervals
+  SlidingSum sliding_sum_;
 
+  template<typename T> void add_segment_(const SampleSegment<T> &segment);
   virtual void reset() override;
 };
 
 class SoundLevelMeterSensorMax : public SoundLevelMeterSensor {
  public:
   void set_window_size(uint32_t window_size);
-  virtual void process(std::vector<float> &buffer) override;
+  // if set, max is taken over windows within this period ending at each update
+  // instead of within update interval
+  void set_sliding_window(uint32_t sliding_window);
+  virtual void set_sample_rate(float sample_rate) override;
+  virtual uint32_t get_samples_to_boundary() override;
+  virtual void add_segment(const SampleSegment<float> &segment) override;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) override;
 
  protected:
+  uint32_t window_size_{0};
   uint32_t window_samples_{0};
   float sum_{0.f};
+  uint64_t sum_fixed_{0};
   float max_{std::numeric_limits<float>::min()};
   uint32_t count_sum_{0}, count_max_{0};
+  uint32_t sliding_window_{0};
+  SlidingExtremum<std::greater<float>> sliding_max_;
 
+  template<typename T>
+  void add_segment_(const SampleSegment<T> &segment, typename SampleTraits<T>::energy_t &sum);
   virtual void reset() override;
 };
 
 class SoundLevelMeterSensorMin : public SoundLevelMeterSensor {
  public:
   void set_window_size(uint32_t window_size);
-  virtual void process(std::vector<float> &buffer) override;
+  // if set, min is taken over windows within this period ending at each update
+  // instead of within update interval
+  void set_sliding_window(uint32_t sliding_window);
+  virtual void set_sample_rate(float sample_rate) override;
+  virtual uint32_t get_samples_to_boundary() override;
+  virtual void add_segment(const SampleSegment<float> &segment) override;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) override;
 
  protected:
+  uint32_t window_size_{0};
   uint32_t window_samples_{0};
   float sum_{0.f};
+  uint64_t sum_fixed_{0};
   float min_{std::numeric_limits<float>::max()};
   uint32_t count_sum_{0}, count_min_{0};
+  uint32_t sliding_window_{0};
+  SlidingExtremum<std::less<float>> sliding_min_;
 
+  template<typename T>
+  void add_segment_(const SampleSegment<T> &segment, typename SampleTraits<T>::energy_t &sum);
   virtual void reset() override;
 };
 
 class SoundLevelMeterSensorPeak : public SoundLevelMeterSensor {
  public:
-  virtual void process(std::vector<float> &buffer) override;
+  virtual bool needs_energy() override { return false; }
+  virtual bool needs_peak() override { return true; }
+  virtual uint32_t get_samples_to_boundary() override;
+  virtual void add_segment(const SampleSegment<float> &segment) override;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) override;
 
  protected:
   float peak_{0.f};
+  uint32_t peak_fixed_{0};
   uint32_t count_{0};
 
+  template<typename T>
+  void add_segment_(const SampleSegment<T> &segment, typename SampleTraits<T>::amplitude_t &peak);
+  virtual void reset() override;
+};
+
+enum TimeWeighting {
+  TIME_WEIGHTING_FAST,
+  TIME_WEIGHTING_SLOW,
+  TIME_WEIGHTING_IMPULSE,
+};
+
+enum TimeWeightedStatistic {
+  TIME_WEIGHTED_MAX,
+  TIME_WEIGHTED_MIN,
+  TIME_WEIGHTED_INSTANTANEOUS,
+};
+
+// IEC 61672 exponentially time weighted level (LAF, LAS, LAI etc.): one pole low pass filter
+// (time constant 125ms for Fast, 1s for Slow) applied to the squared signal, for Impulse the filter
+// rises with 35ms and decays with 1.5s. Reports max, min or the last value over update interval.
+// Time constants are much longer than a millisecond, so squares are averaged over envelope blocks
+// of ~1ms and the filter is updated once per block: results are the same within 0.1dB,
+// but per sample work is the same as for Leq
+class SoundLevelMeterSensorTimeWeighted : public SoundLevelMeterSensor {
+ public:
+  void set_time_weighting(TimeWeighting time_weighting);
+  void set_statistic(TimeWeightedStatistic statistic);
+  virtual void set_sample_rate(float sample_rate) override;
+  virtual uint32_t get_samples_to_boundary() override;
+  virtual void add_segment(const SampleSegment<float> &segment) override;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) override;
+
+ protected:
+  TimeWeighting time_weighting_{TIME_WEIGHTING_FAST};
+  TimeWeightedStatistic statistic_{TIME_WEIGHTED_MAX};
+  uint32_t envelope_samples_{1};
+  // filter coefficients per envelope block for rising and falling signal
+  float rise_alpha_{1.f}, fall_alpha_{1.f};
+  // time weighted mean square, NAN until the first envelope block, so that the filter
+  // starts from the actual level instead of silence
+  float level_{NAN};
+  float stat_{NAN};
+  float sum_{0.f};
+  uint32_t count_envelope_{0}, count_update_{0};
+
+  template<typename T> void add_segment_(const SampleSegment<T> &segment);
+  virtual void reset() override;
+};
+
+// Statistical level LN (e.g. L10, L50, L90): level exceeded during N percent of update interval.
+// Leq over short windows (window_size) is put into a histogram with fixed 0.1dB bins, so insertion
+// is O(1) and memory doesn't depend on update interval, percentile is found once per update
+class SoundLevelMeterSensorPercentile : public SoundLevelMeterSensor {
+ public:
+  void set_window_size(uint32_t window_size);
+  void set_percentile(float percentile);
+  virtual void set_sample_rate(float sample_rate) override;
+  virtual uint32_t get_samples_to_boundary() override;
+  virtual void add_segment(const SampleSegment<float> &segment) override;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) override;
+
+ protected:
+  // histogram range in dB FS, levels outside of it go to the first/last bin
+  static constexpr float HISTOGRAM_MIN_DB = -130.f;
+  static constexpr float HISTOGRAM_MAX_DB = 10.f;
+  static constexpr float HISTOGRAM_BINS_PER_DB = 10.f;
+
+  uint32_t window_size_{125};
+  uint32_t window_samples_{0};
+  float percentile_{50.f};
+  std::vector<uint32_t> histogram_;
+  uint32_t histogram_count_{0};
+  float sum_{0.f};
+  uint32_t count_window_{0}, count_update_{0};
+
+  template<typename T> void add_segment_(const SampleSegment<T> &segment);
+  void add_level(float mean_square);
+  float get_level();
   virtual void reset() override;
 };
 
+#ifdef USE_TIME
+enum ExposureMetric {
+  EXPOSURE_LEX_8H,
+  EXPOSURE_LDEN,
+  EXPOSURE_DOSE,
+};
+
+// Daily noise exposure (LEX,8h, Lden or dose) accumulated by wall clock time in the main loop from energy
+// summed by the audio task, with the state of the day saved to flash so that it survives restarts
+class SoundLevelMeterSensorExposure : public SoundLevelMeterSensor, public Component {
+ public:
+  void set_time(time::RealTimeClock *time);
+  void set_metric(ExposureMetric metric);
+  void set_criterion_level(float criterion_level);
+  void set_checkpoint_interval(uint32_t checkpoint_interval);
+  // local hour when the accumulated day starts over, e.g. 7 for Lden so that the night is not split at midnight
+  void set_day_start_hour(uint8_t day_start_hour);
+  virtual void set_sample_rate(float sample_rate) override;
+  virtual uint32_t get_samples_to_boundary() override;
+  virtual void add_segment(const SampleSegment<float> &segment) override;
+  virtual void add_segment(const SampleSegment<int32_t> &segment) override;
+  virtual void setup() override;
+  virtual void loop() override;
+  virtual void on_shutdown() override;
+
+ protected:
+  enum Period { PERIOD_DAY, PERIOD_EVENING, PERIOD_NIGHT, PERIOD_COUNT };
+  // persisted, energy is sum of 10^(L/10) * seconds
+  struct State {
+    uint32_t date;
+    double energy[PERIOD_COUNT];
+    float duration[PERIOD_COUNT];
+  };
+  struct Interval {
+    double sum;
+    uint32_t count;
+  };
+  time::RealTimeClock *time_{nullptr};
+  ExposureMetric metric_{EXPOSURE_LEX_8H};
+  float criterion_level_{85.f};
+  uint32_t checkpoint_interval_{300000};
+  uint8_t day_start_hour_{0};
+  float sample_rate_{0.f};
+  // audio task state: energy of the current interval, intervals are passed to the main loop
+  double sum_{0.};
+  uint32_t count_{0};
+  SPSCQueue<Interval> intervals_;
+  // main loop state
+  State state_{};
+  ESPPreferenceObject pref_;
+  bool dirty_{false};
+  uint32_t last_checkpoint_{0};
+  // energy and duration of intervals that ended before time was synced
+  double unsynced_energy_{0.};
+  float unsynced_duration_{0.f};
+
+  template<typename T> void add_segment_(const SampleSegment<T> &segment);
+  void add_interval_(const Interval &interval);
+  float get_value_();
+  void checkpoint_();
+  virtual void reset() override;
+};
+#endif
+
 class Filter {
   friend class SensorGroup;
+  friend class FilterBank;
 
  public:
-  virtual void process(std::vector<float> &data) = 0;
+  // processes data in place and returns number of output samples, filters that
+  // reduce sample rate write them to the beginning of data
+  virtual size_t process(float *data, size_t len) = 0;
+  virtual size_t process(int32_t *data, size_t len) = 0;
+  // ratio of input to output sample rate
+  virtual uint8_t get_decimation_factor() { return 1; }
+  // estimated multiply-accumulate operations per input sample, only used for diagnostics
+  virtual float get_cost() { return 0.f; }
 
  protected:
   virtual void reset() = 0;
+  // Called by the DSP task before each block, applies changes of coefficients requested from the main loop.
+  // Returns whether the response changed, then the group restarts its sensors and skips settle_time ms
+  // (set only by filters that override the default warmup interval)
+  virtual bool apply_pending(uint32_t & /*settle_time*/) { return false; }
 };
 
+// Single section of fixed point SOS filter: direct form 1 with 64 bit accumulator.
+// Coefficients are {b0, b1, b2, a1, a2, k1, k2}, state is {x[n-1], x[n-2], y[n-1], y[n-2], r[n-1], r[n-2]}.
+// Rounding residuals r are fed back with small integer coefficients k ~ -a, so that
+// rounding noise is not amplified by poles close to the unit circle (e.g. at 20Hz in A/C-weighting)
+inline int32_t sos_fixed_point_section(const std::array<int32_t, 7> &c, std::array<int32_t, 6> &s, int32_t x) {
+  int64_t acc = int64_t(c[0]) * x + int64_t(c[1]) * s[0] + int64_t(c[2]) * s[1] - int64_t(c[3]) * s[2] -
+                int64_t(c[4]) * s[3] + int64_t(c[5]) * s[4] + int64_t(c[6]) * s[5];
+  int64_t y = (acc + (int64_t(1) << (FIXED_POINT_COEFF_FRAC_BITS - 1))) >> FIXED_POINT_COEFF_FRAC_BITS;
+  int32_t r = int32_t(acc - (y << FIXED_POINT_COEFF_FRAC_BITS));
+  if (y > INT32_MAX || y < INT32_MIN) {
+    y = y > 0 ? INT32_MAX : INT32_MIN;
+    r = 0;
+  }
+  s[1] = s[0];
+  s[0] = x;
+  s[3] = s[2];
+  s[2] = int32_t(y);
+  s[5] = s[4];
+  s[4] = r;
+  return int32_t(y);
+}
+
+// converts float {b0, b1, b2, a1, a2} to sos_fixed_point_section() coefficients
+std::array<int32_t, 7> to_fixed_point_section(const std::array<float, 5> &coeffs);
+
 class SOS_Filter : public Filter {
  public:
   SOS_Filter(std::initializer_list<std::initializer_list<float>> &&coeffs);
-  virtual void process(std::vector<float> &data) override;
+  virtual size_t process(float *data, size_t len) override;
+  virtual size_t process(int32_t *data, size_t len) override;
+  virtual float get_cost() override;
 
  protected:
   std::vector<std::array<float, 5>> coeffs_;  // {b0, b1, b2, a1, a2}
   std::vector<std::array<float, 2>> state_;
+  std::vector<std::array<int32_t, 7>> coeffs_fixed_;
+  std::vector<std::array<int32_t, 6>> state_fixed_;
 
   virtual void reset() override;
 };
 
+// SOS filter with named coefficient sets (e.g. A, C and Z-weighting), switched from the main loop through
+// a double buffer that the DSP task swaps between blocks
+class SwitchableSOS_Filter : public Filter {
+ public:
+  // {b0, b1, b2, a1, a2} of each section
+  using SOSCoeffs = std::vector<std::array<float, 5>>;
+
+  // the first set is active initially
+  void add_set(const char *name, SOSCoeffs coeffs);
+  // whether filter state is cleared when switching, otherwise it goes on with the new coefficients
+  void set_reset_state(bool reset_state);
+  // audio to skip by sensors after switching, default is the warmup interval of the meter
+  void set_settle_time(uint32_t settle_time);
+  // called from the main loop, returns false if there is no set with this name
+  bool select(const std::string &name);
+  // user supplied {b0, b1, b2, a1, a2} sections, at most as many as in the longest set, called from the main loop
+  bool set_coeffs(const SOSCoeffs &coeffs);
+  virtual size_t process(float *data, size_t len) override;
+  virtual size_t process(int32_t *data, size_t len) override;
+  virtual float get_cost() override;
+
+ protected:
+  struct Set {
+    const char *name;
+    SOSCoeffs coeffs;
+    std::vector<std::array<int32_t, 7>> coeffs_fixed;
+  };
+  std::vector<Set> sets_;
+  // slots_[active_] is used by the DSP task, the other one is written by the main loop
+  std::array<Set, 2> slots_;
+  uint8_t active_{0};
+  std::atomic<bool> pending_{false};
+  // slot written by the last request, and its number of sections (for get_cost())
+  uint8_t requested_slot_{0};
+  size_t sections_{0};
+  // sized for the longest set
+  std::vector<std::array<float, 2>> state_;
+  std::vector<std::array<int32_t, 6>> state_fixed_;
+  bool reset_state_{true};
+  optional<uint32_t> settle_time_{};
+
+  void request_(const Set &set);
+  virtual bool apply_pending(uint32_t &settle_time) override;
+  virtual void reset() override;
+};
+
+// Same as SOS_Filter, but number of sections is known at compile time, so the compiler
+// can unroll the cascade and keep coefficients and states in registers. All sections
+// are applied to a sample before moving to the next one, so the buffer is traversed only once
+template<size_t N> class FusedSOS_Filter : public Filter {
+ public:
+  FusedSOS_Filter(std::initializer_list<std::initializer_list<float>> &&coeffs) {
+    int i = 0;
+    for (auto &row : coeffs)
+      std::copy(row.begin(), row.end(), this->coeffs_[i++].begin());
+    for (size_t j = 0; j < N; j++)
+      this->coeffs_fixed_[j] = to_fixed_point_section(this->coeffs_[j]);
+    this->reset();
+  }
+
+  // direct form 2 transposed
+  virtual size_t process(float *data, size_t len) override {
+    const std::array<std::array<float, 5>, N> c = this->coeffs_;
+    std::array<std::array<float, 2>, N> s = this->state_;
+    for (size_t i = 0; i < len; i++) {
+      float x = data[i];
+      for (size_t j = 0; j < N; j++) {
+        float y = c[j][0] * x + s[j][0];
+        s[j][0] = c[j][1] * x - c[j][3] * y + s[j][1];
+        s[j][1] = c[j][2] * x - c[j][4] * y;
+        x = y;
+      }
+      data[i] = x;
+    }
+    this->state_ = s;
+    return len;
+  }
+
+  virtual size_t process(int32_t *data, size_t len) override {
+    const std::array<std::array<int32_t, 7>, N> c = this->coeffs_fixed_;
+    std::array<std::array<int32_t, 6>, N> s = this->state_fixed_;
+    for (size_t i = 0; i < len; i++) {
+      int32_t x = data[i];
+      for (size_t j = 0; j < N; j++)
+        x = sos_fixed_point_section(c[j], s[j], x);
+      data[i] = x;
+    }
+    this->state_fixed_ = s;
+    return len;
+  }
+
+  virtual float get_cost() override { return 5.f * N; }
+
+ protected:
+  std::array<std::array<float, 5>, N> coeffs_;  // {b0, b1, b2, a1, a2}
+  std::array<std::array<float, 2>, N> state_;
+  std::array<std::array<int32_t, 7>, N> coeffs_fixed_;
+  std::array<std::array<int32_t, 6>, N> state_fixed_;
+
+  virtual void reset() override {
+    for (auto &s : this->state_)
+      s = {0.f, 0.f};
+    for (auto &s : this->state_fixed_)
+      s = {};
+  }
+};
+
+// Reduces sample rate by an integer factor. Anti-aliasing filter is a linear phase FIR, which is
+// evaluated only for the samples that are kept (polyphase decimation). Symmetric taps are folded
+// and zero taps (every other one in halfband filters) are skipped, so the cost per output sample
+// is about a quarter of the number of taps for halfband filters
+class DecimationFilter : public Filter {
+ public:
+  // taps must be symmetric with odd length
+  DecimationFilter(uint8_t factor, std::initializer_list<float> &&taps);
+  virtual size_t process(float *data, size_t len) override;
+  virtual size_t process(int32_t *data, size_t len) override;
+  virtual uint8_t get_decimation_factor() override;
+  virtual float get_cost() override;
+
+ protected:
+  // input is copied in chunks after the last (taps - 1) samples, so that output could be
+  // written in place of already consumed input
+  static const size_t CHUNK_SIZE = 128;
+
+  uint8_t factor_;
+  // distance of center tap from both ends
+  size_t delay_;
+  float center_tap_;
+  int32_t center_tap_fixed_;
+  // nonzero taps of one half, with distances from the center
+  std::vector<size_t> offsets_;
+  std::vector<float> taps_;
+  std::vector<int32_t> taps_fixed_;
+  std::vector<float> buffer_;
+  std::vector<int32_t> buffer_fixed_;
+  // number of input samples to skip before the next output sample
+  size_t phase_{0};
+
+  template<typename Acc, typename T>
+  size_t process_(T *data, size_t len, std::vector<T> &buffer, T center_tap, const std::vector<T> &taps);
+  virtual void reset() override;
+};
+
 template<typename... Ts> class TurnOnAction : public Action<Ts...> {
  public:
   explicit TurnOnAction(SoundLevelMeter *sound_level_meter) : sound_level_meter_(sound_level_meter) {}
@@ -196,6 +1281,74 @@ template<typename... Ts> class TurnOffAction : public Action<Ts...> {
   SoundLevelMeter *sound_level_meter_;
 };
 
+class ThresholdTrigger : public Trigger<float> {
+ public:
+  explicit ThresholdTrigger(SoundLevelMeterSensor *parent) {
+    parent->add_on_threshold_callback([this](float level) { this->trigger(level); });
+  }
+};
+
+class SnapshotTrigger : public Trigger<> {
+ public:
+  explicit SnapshotTrigger(SoundLevelMeter *parent) {
+    parent->add_on_snapshot_callback([this]() { this->trigger(); });
+  }
+};
+
+template<typename... Ts> class TakeSnapshotAction : public Action<Ts...> {
+ public:
+  explicit TakeSnapshotAction(SoundLevelMeter *sound_level_meter) : sound_level_meter_(sound_level_meter) {}
+
+  void play(Ts... x) override { this->sound_level_meter_->take_snapshot(); }
+
+ protected:
+  SoundLevelMeter *sound_level_meter_;
+};
+
+template<typename... Ts> class ReleaseSnapshotAction : public Action<Ts...> {
+ public:
+  explicit ReleaseSnapshotAction(SoundLevelMeter *sound_level_meter) : sound_level_meter_(sound_level_meter) {}
+
+  void play(Ts... x) override { this->sound_level_meter_->release_snapshot(); }
+
+ protected:
+  SoundLevelMeter *sound_level_meter_;
+};
+
+class HistoryExportTrigger : public Trigger<std::vector<HistoryRecord>> {
+ public:
+  explicit HistoryExportTrigger(SoundLevelMeter *parent) {
+    parent->add_on_history_export_callback([this](std::vector<HistoryRecord> records) { this->trigger(records); });
+  }
+};
+
+template<typename... Ts> class ExportHistoryAction : public Action<Ts...> {
+ public:
+  explicit ExportHistoryAction(SoundLevelMeter *sound_level_meter) : sound_level_meter_(sound_level_meter) {}
+
+  void play(Ts... x) override { this->sound_level_meter_->export_history(); }
+
+ protected:
+  SoundLevelMeter *sound_level_meter_;
+};
+
+class SampleLossTrigger : public Trigger<float> {
+ public:
+  explicit SampleLossTrigger(SoundLevelMeter *parent) {
+    parent->add_on_sample_loss_callback([this](float loss) { this->trigger(loss); });
+  }
+};
+
+template<typename... Ts> class DumpProfileAction : public Action<Ts...> {
+ public:
+  explicit DumpProfileAction(SoundLevelMeter *sound_level_meter) : sound_level_meter_(sound_level_meter) {}
+
+  void play(Ts... x) override { this->sound_level_meter_->dump_profile(); }
+
+ protected:
+  SoundLevelMeter *sound_level_meter_;
+};
+
 template<typename... Ts> class ToggleAction : public Action<Ts...> {
  public:
   explicit ToggleAction(SoundLevelMeter *sound_level_meter) : sound_level_meter_(sound_level_meter) {}
@@ -206,5 +1359,53 @@ template<typename... Ts> class ToggleAction : public Action<Ts...> {
   SoundLevelMeter *sound_level_meter_;
 };
 
+template<typename... Ts> class GroupTurnOnAction : public Action<Ts...> {
+ public:
+  explicit GroupTurnOnAction(SensorGroup *group) : group_(group) {}
+
+  void play(Ts... x) override { this->group_->turn_on(); }
+
+ protected:
+  SensorGroup *group_;
+};
+
+template<typename... Ts> class GroupTurnOffAction : public Action<Ts...> {
+ public:
+  explicit GroupTurnOffAction(SensorGroup *group) : group_(group) {}
+
+  void play(Ts... x) override { this->group_->turn_off(); }
+
+ protected:
+  SensorGroup *group_;
+};
+
+template<typename... Ts> class GroupToggleAction : public Action<Ts...> {
+ public:
+  explicit GroupToggleAction(SensorGroup *group) : group_(group) {}
+
+  void play(Ts... x) override { this->group_->toggle(); }
+
+ protected:
+  SensorGroup *group_;
+};
+
+// switches SwitchableSOS_Filter to a named set, or to coefficients returned by a lambda
+template<typename... Ts> class SetCoeffsAction : public Action<Ts...> {
+ public:
+  explicit SetCoeffsAction(SwitchableSOS_Filter *filter) : filter_(filter) {}
+  TEMPLATABLE_VALUE(std::string, set_name)
+  TEMPLATABLE_VALUE(SwitchableSOS_Filter::SOSCoeffs, coeffs)
+
+  void play(Ts... x) override {
+    if (this->set_name_.has_value())
+      this->filter_->select(this->set_name_.value(x...));
+    else
+      this->filter_->set_coeffs(this->coeffs_.value(x...));
+  }
+
+ protected:
+  SwitchableSOS_Filter *filter_;
+};
+
 }  // namespace sound_level_meter
 }  // namespace esphome
\ No newline at end of file
@@ -0,0 +1,130 @@
+// Microbenchmark of sensor accumulation: a single group without filters is fed with white noise
+// and throughput is printed in millions of samples per second for every sensor type and buffer size,
+// for float and fixed point processing.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "sound_level_meter/sound_level_meter.h"
+
+using namespace esphome;
+using namespace esphome::sound_level_meter;
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const size_t BUFFER_SIZES[] = {256, 512, 1024, 2048, 4096};
+
+// only provides sample rate, data is passed to process() directly
+class NullSampleSource : public SampleSource {
+ public:
+  virtual uint32_t get_sample_rate() override { return SAMPLE_RATE; }
+  virtual bool read_samples(float * /*data*/, size_t /*num_samples*/, size_t * /*samples_read*/) override {
+    return false;
+  }
+  virtual bool read_samples(int32_t * /*data*/, size_t /*num_samples*/, size_t * /*samples_read*/) override {
+    return false;
+  }
+};
+
+struct SensorType {
+  const char *name;
+  // sensors added to the group: e(q), (ma)x, mi(n), p(eak), t(ime weighted), l(evel percentile)
+  std::string sensors;
+};
+
+static const SensorType SENSOR_TYPES[] = {
+    {"eq", "e"},
+    {"max", "x"},
+    {"min", "n"},
+    {"peak", "p"},
+    {"time_weighted", "t"},
+    {"percentile", "l"},
+    {"eq+max+min+peak", "exnp"},
+};
+
+static SoundLevelMeterSensor *make_sensor(char type) {
+  switch (type) {
+    case 'e':
+      return new SoundLevelMeterSensorEq();
+    case 'x': {
+      auto *s = new SoundLevelMeterSensorMax();
+      s->set_window_size(1000);
+      return s;
+    }
+    case 'n': {
+      auto *s = new SoundLevelMeterSensorMin();
+      s->set_window_size(1000);
+      return s;
+    }
+    case 'p':
+      return new SoundLevelMeterSensorPeak();
+    case 't':
+      return new SoundLevelMeterSensorTimeWeighted();
+    default:
+      return new SoundLevelMeterSensorPercentile();
+  }
+}
+
+template<typename T> static double run(const SensorType &type, size_t buffer_size, const std::vector<T> &data) {
+  NullSampleSource source;
+  auto *meter = new SoundLevelMeter();
+  meter->set_source(&source);
+  meter->set_update_interval(1000);
+  meter->set_buffer_size(buffer_size);
+  meter->set_fixed_point(std::is_same<T, int32_t>::value);
+  auto *group = new SensorGroup();
+  group->set_parent(meter);
+  for (char c : type.sensors) {
+    auto *s = make_sensor(c);
+    s->set_parent(meter);
+    group->add_sensor(s);
+  }
+  meter->add_group(group);
+  meter->setup();
+
+  std::vector<T> buffer(buffer_size);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t offset = 0; offset + buffer_size <= data.size(); offset += buffer_size) {
+    // process() works in place, so every block gets a fresh copy
+    std::copy(data.begin() + offset, data.begin() + offset + buffer_size, buffer.begin());
+    meter->process(buffer.data(), buffer_size);
+    meter->loop();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return (data.size() / buffer_size * buffer_size) / elapsed / 1e6;
+}
+
+template<typename T> static void run_all(const char *title, const std::vector<T> &data) {
+  printf("%s, Msamples/s\n%-16s", title, "sensors");
+  for (auto size : BUFFER_SIZES)
+    printf("%10zu", size);
+  printf("\n");
+  for (auto &type : SENSOR_TYPES) {
+    printf("%-16s", type.name);
+    for (auto size : BUFFER_SIZES)
+      printf("%10.1f", run(type, size, data));
+    printf("\n");
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  float seconds = argc > 1 ? atof(argv[1]) : 60.f;
+  if (!(seconds > 0)) {
+    fprintf(stderr, "Usage: %s [SECONDS_OF_AUDIO]\n", argv[0]);
+    return 2;
+  }
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0.f, 0.1f);
+  std::vector<float> data(size_t(seconds * SAMPLE_RATE));
+  std::vector<int32_t> data_fixed(data.size());
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = noise(rng);
+    data_fixed[i] = to_fixed_point(data[i], FIXED_POINT_FRAC_BITS);
+  }
+  run_all("float", data);
+  run_all("fixed point", data_fixed);
+  return 0;
+}
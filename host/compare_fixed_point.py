@@ -0,0 +1,63 @@
+# Replays the same audio through float and fixed point pipelines and compares every
+# published value, exits with code 1 if any of them differs by more than --tolerance.
+# Usage: compare_fixed_point.py [--replay PATH] [--tolerance DB] -- REPLAY_ARGS...
+
+import argparse
+import math
+import os
+import subprocess
+import sys
+
+
+def replay(command):
+    """Returns {(time, sensor name): value} of values printed by replay"""
+    output = subprocess.run(
+        command,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.DEVNULL,
+        check=True,
+        text=True,
+    ).stdout
+    values = {}
+    for line in output.splitlines():
+        time, name, value = line.rsplit(",", 2)
+        values[(time, name)] = float(value)
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    default_replay = os.path.join(
+        os.path.dirname(__file__), "build", "sound_level_meter_replay"
+    )
+    parser.add_argument("--replay", default=default_replay)
+    parser.add_argument("--tolerance", type=float, default=0.1)
+    parser.add_argument("args", nargs="+")
+    args = parser.parse_args()
+
+    reference = replay([args.replay] + args.args)
+    fixed = replay([args.replay, "--fixed-point"] + args.args)
+    if reference.keys() != fixed.keys():
+        print("Float and fixed point pipelines published different values")
+        return 1
+    # max difference per sensor
+    diffs = {}
+    for (time, name), value in reference.items():
+        other = fixed[(time, name)]
+        if math.isnan(value) or math.isnan(other):
+            diff = 0 if math.isnan(value) and math.isnan(other) else math.inf
+        else:
+            diff = abs(value - other)
+        if diff > diffs.get(name, (-1, None))[0]:
+            diffs[name] = (diff, time)
+    failed = False
+    for name, (diff, time) in sorted(diffs.items()):
+        ok = diff <= args.tolerance
+        failed |= not ok
+        status = "" if ok else ", FAILED"
+        print(f"{name}: max difference {diff:.3f}dB at {time}s{status}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
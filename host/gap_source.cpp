@@ -0,0 +1,42 @@
+#include "gap_source.h"
+
+namespace esphome {
+namespace sound_level_meter {
+
+GapSampleSource::GapSampleSource(SampleSource *source, uint32_t interval, uint32_t length)
+    : source_(source), interval_(interval), length_(length), until_gap_(interval) {}
+
+uint32_t GapSampleSource::get_sample_rate() { return this->source_->get_sample_rate(); }
+uint32_t GapSampleSource::get_dropped_samples() { return this->dropped_samples_; }
+
+bool GapSampleSource::read_samples(float *data, size_t num_samples, size_t *samples_read) {
+  return this->read_samples_(data, num_samples, samples_read);
+}
+
+bool GapSampleSource::read_samples(int32_t *data, size_t num_samples, size_t *samples_read) {
+  return this->read_samples_(data, num_samples, samples_read);
+}
+
+template<typename T> bool GapSampleSource::read_samples_(T *data, size_t num_samples, size_t *samples_read) {
+  size_t n = 0, r;
+  while (n < num_samples) {
+    if (this->until_gap_ == 0) {
+      // the rest of the output buffer is used as a scratch for skipped samples
+      for (size_t left = this->length_; left > 0; left -= r) {
+        if (!this->source_->read_samples(data + n, std::min<size_t>(left, num_samples - n), &r))
+          break;
+        this->dropped_samples_ += r;
+      }
+      this->until_gap_ = this->interval_;
+    }
+    if (!this->source_->read_samples(data + n, std::min<size_t>(num_samples - n, this->until_gap_), &r))
+      break;
+    n += r;
+    this->until_gap_ -= r;
+  }
+  *samples_read = n;
+  return n > 0;
+}
+
+}  // namespace sound_level_meter
+}  // namespace esphome
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "sound_level_meter/sound_level_meter.h"
+
+namespace esphome {
+namespace sound_level_meter {
+
+// Simulates I2S DMA overflows on top of another source: after every `interval` delivered samples
+// the next `length` samples are read and thrown away, as if the reader was too late to get them.
+// Thrown away samples are reported by get_dropped_samples(), like I2SComponent does it.
+class GapSampleSource : public SampleSource {
+ public:
+  GapSampleSource(SampleSource *source, uint32_t interval, uint32_t length);
+  virtual uint32_t get_sample_rate() override;
+  virtual bool read_samples(float *data, size_t num_samples, size_t *samples_read) override;
+  virtual bool read_samples(int32_t *data, size_t num_samples, size_t *samples_read) override;
+  virtual uint32_t get_dropped_samples() override;
+
+ protected:
+  SampleSource *source_;
+  uint32_t interval_;
+  uint32_t length_;
+  uint32_t until_gap_;
+  uint32_t dropped_samples_{0};
+
+  template<typename T> bool read_samples_(T *data, size_t num_samples, size_t *samples_read);
+};
+
+}  // namespace sound_level_meter
+}  // namespace esphome
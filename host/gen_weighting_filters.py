@@ -0,0 +1,85 @@
+# Generates weighting_filters.h for replay: A and C-weighting filters designed by
+# filter_design.py (the same as `type: weighting` in the config) for common rates.
+# Usage: python3 gen_weighting_filters.py OUTPUT
+
+import os
+import sys
+
+sys.path.insert(
+    0,
+    os.path.join(os.path.dirname(__file__), "..", "components", "sound_level_meter"),
+)
+# pylint: disable-next=wrong-import-position,import-error
+from filter_design import iec_61672_class, weighting_filter
+
+SAMPLE_RATES = [8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000, 88200, 96000]
+
+
+def float_literal(value):
+    text = f"{value:.9g}"
+    if not any(c in text for c in ".en"):
+        text += "."
+    return text + "f"
+
+
+def sos_literal(sos):
+    rows = ", ".join("{" + ", ".join(map(float_literal, row)) + "}" for row in sos)
+    return "{" + rows + "}"
+
+
+def main(output):
+    os.makedirs(os.path.dirname(output), exist_ok=True)
+    lines = [
+        "// Generated by gen_weighting_filters.py, do not edit",
+        "#pragma once",
+        "",
+        '#include "sound_level_meter/sound_level_meter.h"',
+        "",
+        "namespace esphome {",
+        "namespace sound_level_meter {",
+        "",
+        "// nullptr if there are no coefficients for this sample rate (or they are",
+        "// out of IEC 61672 class 2 tolerances, like in config validation)",
+        "inline Filter *make_weighting_filter(uint32_t sample_rate, char weighting, "
+        "bool generic_sos) {",
+    ]
+    filters = []
+    for fs in SAMPLE_RATES:
+        for weighting in "AC":
+            sos = weighting_filter(weighting, fs)
+            if iec_61672_class(sos, weighting, fs) is not None:
+                filters.append((fs, weighting, sos))
+    for fs, weighting, sos in filters:
+        coeffs = sos_literal(sos)
+        lines += [
+            f"  if (sample_rate == {fs} && weighting == '{weighting}')",
+            f"    return generic_sos ? static_cast<Filter *>(new SOS_Filter({coeffs}))",
+            f"                       : new FusedSOS_Filter<{len(sos)}>({coeffs});",
+        ]
+    lines += [
+        "  return nullptr;",
+        "}",
+        "",
+        "// the same coefficients as a set of SwitchableSOS_Filter, empty if none",
+        "inline SwitchableSOS_Filter::SOSCoeffs weighting_coeffs(uint32_t sample_rate, "
+        "char weighting) {",
+    ]
+    for fs, weighting, sos in filters:
+        lines += [
+            f"  if (sample_rate == {fs} && weighting == '{weighting}')",
+            f"    return {sos_literal(sos)};",
+        ]
+    lines += [
+        "  return {};",
+        "}",
+        "",
+        "}  // namespace sound_level_meter",
+        "}  // namespace esphome",
+        "",
+    ]
+    with open(output, "w", encoding="utf-8") as f:
+        f.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1])
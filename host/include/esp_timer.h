@@ -0,0 +1,11 @@
+#pragma once
+
+// Host replacement for ESP-IDF's esp_timer, only the bits used by the components
+
+#include <chrono>
+#include <cstdint>
+
+inline int64_t esp_timer_get_time() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
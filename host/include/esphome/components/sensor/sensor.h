@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
+
+#define LOG_SENSOR(prefix, type, obj) \
+  if ((obj) != nullptr) { \
+    ESP_LOGCONFIG(TAG, "%s%s '%s'", prefix, type, (obj)->get_name().c_str()); \
+  }
+
+namespace esphome {
+namespace sensor {
+
+class Sensor {
+ public:
+  virtual ~Sensor() = default;
+  void set_name(const std::string &name) { this->name_ = name; }
+  const std::string &get_name() const { return this->name_; }
+  uint32_t get_object_id_hash() const { return fnv1_hash(this->name_); }
+  void set_internal(bool internal) { this->internal_ = internal; }
+  bool is_internal() const { return this->internal_; }
+  void add_on_state_callback(std::function<void(float)> &&callback) { this->callback_.add(std::move(callback)); }
+  void add_on_raw_state_callback(std::function<void(float)> &&callback) {
+    this->raw_callback_.add(std::move(callback));
+  }
+  // no filters on host, raw and filtered states are the same
+  void publish_state(float state) {
+    this->raw_callback_.call(state);
+    this->state = state;
+    this->has_state_ = true;
+    this->callback_.call(state);
+  }
+  bool has_state() const { return this->has_state_; }
+
+  float state{NAN};
+
+ protected:
+  std::string name_;
+  bool internal_{false};
+  bool has_state_{false};
+  CallbackManager<void(float)> raw_callback_;
+  CallbackManager<void(float)> callback_;
+};
+
+}  // namespace sensor
+}  // namespace esphome
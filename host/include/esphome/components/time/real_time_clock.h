@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include "esphome/core/component.h"
+
+namespace esphome {
+
+// broken down local time, only the fields used by the component
+struct ESPTime {
+  uint8_t second;
+  uint8_t minute;
+  uint8_t hour;
+  uint16_t day_of_year;
+  uint16_t year;
+  time_t timestamp;
+
+  bool is_valid() const { return this->year >= 2019; }
+
+  static ESPTime from_epoch_local(time_t epoch) {
+    struct tm c;
+    localtime_r(&epoch, &c);
+    return {uint8_t(c.tm_sec), uint8_t(c.tm_min), uint8_t(c.tm_hour), uint16_t(c.tm_yday + 1),
+            uint16_t(c.tm_year + 1900), epoch};
+  }
+};
+
+namespace time {
+
+// Time is set explicitly instead of being synchronized, e.g. offline replay advances it with processed audio
+class RealTimeClock : public Component {
+ public:
+  void set_epoch_time(time_t epoch) { this->epoch_ = epoch; }
+  ESPTime now() { return ESPTime::from_epoch_local(this->epoch_); }
+
+ protected:
+  time_t epoch_{0};
+};
+
+}  // namespace time
+}  // namespace esphome
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <type_traits>
+
+namespace esphome {
+
+template<typename... Ts> class Action {
+ public:
+  virtual ~Action() = default;
+  virtual void play(Ts... x) = 0;
+};
+
+// automations are not available on host, callbacks could be added directly to components instead
+template<typename... Ts> class Trigger {
+ public:
+  void trigger(Ts... x) {}
+};
+
+// constant or lambda of action arguments
+template<typename T, typename... X> class TemplatableValue {
+ public:
+  TemplatableValue() = default;
+  template<typename V, typename std::enable_if<!std::is_invocable<V, X...>::value, int>::type = 0>
+  TemplatableValue(V value) : f_([value](X...) -> T { return value; }) {}
+  template<typename F, typename std::enable_if<std::is_invocable<F, X...>::value, int>::type = 0>
+  TemplatableValue(F f) : f_(f) {}
+
+  bool has_value() const { return bool(this->f_); }
+  T value(X... x) const { return this->f_(x...); }
+
+ protected:
+  std::function<T(X...)> f_;
+};
+
+#define TEMPLATABLE_VALUE_(type, name) \
+ protected: \
+  TemplatableValue<type, Ts...> name##_{}; \
+\
+ public: \
+  template<typename V> void set_##name(V name) { this->name##_ = name; }
+
+#define TEMPLATABLE_VALUE(type, name) TEMPLATABLE_VALUE_(type, name)
+
+}  // namespace esphome
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_timer.h"
+
+namespace esphome {
+
+inline uint32_t millis() { return uint32_t(esp_timer_get_time() / 1000); }
+inline uint32_t micros() { return uint32_t(esp_timer_get_time()); }
+
+}  // namespace esphome
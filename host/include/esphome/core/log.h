@@ -0,0 +1,32 @@
+#pragma once
+
+// Host logger: everything goes to stderr, so stdout stays clean for tool output
+
+#include <cstdio>
+#include <math.h>
+
+namespace esphome {
+
+enum HostLogLevel { HOST_LOG_ERROR = 1, HOST_LOG_WARN, HOST_LOG_INFO, HOST_LOG_CONFIG, HOST_LOG_DEBUG, HOST_LOG_VERBOSE };
+
+inline int &host_log_level() {
+  static int level = HOST_LOG_INFO;
+  return level;
+}
+
+}  // namespace esphome
+
+#define ESPHOME_HOST_LOG(level, letter, tag, format, ...) \
+  do { \
+    if (esphome::host_log_level() >= (level)) \
+      fprintf(stderr, "[" letter "][%s] " format "\n", tag, ##__VA_ARGS__); \
+  } while (0)
+
+#define ESP_LOGE(tag, ...) ESPHOME_HOST_LOG(esphome::HOST_LOG_ERROR, "E", tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) ESPHOME_HOST_LOG(esphome::HOST_LOG_WARN, "W", tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) ESPHOME_HOST_LOG(esphome::HOST_LOG_INFO, "I", tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...) ESPHOME_HOST_LOG(esphome::HOST_LOG_CONFIG, "C", tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) ESPHOME_HOST_LOG(esphome::HOST_LOG_DEBUG, "D", tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) ESPHOME_HOST_LOG(esphome::HOST_LOG_VERBOSE, "V", tag, __VA_ARGS__)
+
+#define YESNO(b) ((b) ? "YES" : "NO")
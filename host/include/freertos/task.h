@@ -0,0 +1,70 @@
+#pragma once
+
+// Host replacement for FreeRTOS tasks on top of std::thread. Priorities and core
+// affinity are ignored, stack is managed by the OS.
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+// only what is needed for direct to task notifications
+struct HostTask {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notify_value{0};
+};
+typedef HostTask *TaskHandle_t;
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+inline TaskHandle_t &host_current_task() {
+  thread_local TaskHandle_t task = nullptr;
+  return task;
+}
+
+// threads not created by xTaskCreatePinnedToCore (e.g. main) get their handle on first use
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  TaskHandle_t &task = host_current_task();
+  if (task == nullptr)
+    task = new HostTask();
+  return task;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                                          UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id) {
+  auto *task = new HostTask();
+  if (handle != nullptr)
+    *handle = task;
+  std::thread([fn, param, task]() {
+    host_current_task() = task;
+    fn(param);
+  }).detach();
+  return pdPASS;
+}
+
+inline void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  std::lock_guard<std::mutex> lock(task->mutex);
+  task->notify_value++;
+  task->cv.notify_one();
+  return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  auto notified = [task] { return task->notify_value > 0; };
+  if (ticks_to_wait == portMAX_DELAY)
+    task->cv.wait(lock, notified);
+  else
+    task->cv.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), notified);
+  uint32_t value = task->notify_value;
+  if (value > 0)
+    task->notify_value = clear_on_exit ? 0 : value - 1;
+  return value;
+}
@@ -0,0 +1,449 @@
+// Offline replay of recorded audio through the sound_level_meter processing pipeline.
+//
+// Audio files are streamed one after another as a single continuous recording in
+// buffer_size chunks, exactly like the I2S task does on device, but as fast as the
+// CPU allows. Every published sensor value is printed to stdout as
+// "<seconds since start>,<sensor name>,<value>", threshold crossings as
+// "<seconds since start>,<sensor name> threshold,<level>", processing stats go to stderr.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "sound_level_meter/sound_level_meter.h"
+#include "gap_source.h"
+#include "wav_source.h"
+#include "weighting_filters.h"
+
+using namespace esphome;
+using namespace esphome::sound_level_meter;
+
+static const char *const TAG = "replay";
+
+struct Options {
+  uint32_t buffer_size{1024};
+  uint32_t update_interval{1000};
+  uint32_t window_size{1000};
+  optional<float> mic_sensitivity{};
+  optional<float> mic_sensitivity_ref{};
+  optional<float> offset{};
+  std::string weightings{"ZAC"};
+  std::string time_weightings{};
+  uint32_t switch_interval{10000};
+  optional<float> threshold{};
+  uint32_t threshold_duration{0};
+  uint32_t snapshot{0};
+  uint32_t snapshot_post_trigger{0};
+  std::string snapshot_file{};
+  uint16_t tap_port{0};
+  uint8_t tap_buffers{8};
+  bool tap_wait{false};
+  uint32_t history{0};
+  optional<time_t> exposure_start{};
+  bool generic_sos{false};
+  bool fixed_point{false};
+  uint8_t workers{1};
+  bool profile{false};
+  uint32_t gap_interval{0};
+  uint32_t gap_length{0};
+  optional<uint32_t> expect_dropped_samples{};
+  RawFormat raw_format{};
+  std::vector<std::string> files;
+};
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "Usage: %s [options] FILE...\n"
+          "\n"
+          "Replays WAV or raw PCM files through the sound level meter pipeline.\n"
+          "\n"
+          "Options:\n"
+          "  --buffer-size N          samples per processing block (default: 1024)\n"
+          "  --update-interval MS     sensors update interval (default: 1000)\n"
+          "  --window-size MS         window size for max/min sensors (default: 1000)\n"
+          "  --weighting ZAC          frequency weightings to compute (default: ZAC), S is a single filter\n"
+          "                           switching between A, C and Z at runtime, A and C filters are\n"
+          "                           designed by filter_design.py for the sample rate of the input\n"
+          "  --switch-interval MS     how often S switches to the next weighting (default: 10000)\n"
+          "  --time-weighting FSI     add Fast/Slow/Impulse time weighted max and min sensors (default: none)\n"
+          "  --threshold DB           report when peak sensors cross this level (default: none)\n"
+          "  --threshold-duration MS  only if the level stays above threshold that long (default: 0)\n"
+          "  --snapshot MS            keep the last MS of input audio in a snapshot buffer (default: 0, none)\n"
+          "  --snapshot-post MS       how much of the snapshot is recorded after the trigger (default: 0)\n"
+          "  --snapshot-file FILE     write snapshot taken at the first threshold crossing as WAV file\n"
+          "  --tap-port PORT          stream output of the first group's filters to a TCP client on PORT,\n"
+          "                           requires build with -DSOUND_LEVEL_METER_TAP=ON (default)\n"
+          "  --tap-buffers N          number of tap buffers, blocks are dropped when all are in use (default: 8)\n"
+          "  --tap-wait               wait for a tap client to connect before processing\n"
+          "  --history BYTES          record all sensors into history of that size and export it at the end\n"
+          "  --exposure EPOCH         add LEX,8h, Lden and dose sensors, with audio starting at EPOCH (local time\n"
+          "                           zone from TZ)\n"
+          "  --generic-sos            use generic SOS_Filter instead of the fused kernel\n"
+          "  --fixed-point            use fixed point processing instead of float\n"
+          "  --workers N              process top level groups in N parallel threads (default: 1)\n"
+          "  --mic-sensitivity DB     microphone sensitivity, e.g. -26\n"
+          "  --mic-sensitivity-ref DB microphone sensitivity reference, e.g. 94\n"
+          "  --offset DB              additional offset\n"
+          "  --raw-format FMT         format of raw PCM files: s16, s24, s32 or f32 (default: s32)\n"
+          "  --raw-sample-rate HZ     sample rate of raw PCM files (default: 48000)\n"
+          "  --raw-channels N         number of interleaved channels in raw PCM files (default: 1)\n"
+          "  --channel N              channel to use from multichannel files (default: 0)\n"
+          "  --bits-shift N           right shift applied to integer samples, like i2s bits_shift (default: 0)\n"
+          "  --gap-interval MS        simulate I2S DMA overflows: drop --gap-length of audio every MS of audio\n"
+          "  --gap-length MS          length of simulated overflows (default: 0, no gaps)\n"
+          "  --expect-dropped-samples N\n"
+          "                           exit with code 3 if a different count of dropped samples is reported\n"
+          "  --profile                log processing time of every filter, sensor and group at the end,\n"
+          "                           requires build with -DSOUND_LEVEL_METER_PROFILING=ON\n"
+          "  --verbose                print config and debug logs to stderr\n",
+          argv0);
+}
+
+static bool parse_args(int argc, char **argv, Options &opts) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto next = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing value for %s\n", arg.c_str());
+        exit(2);
+      }
+      return argv[++i];
+    };
+    if (arg == "--buffer-size") {
+      opts.buffer_size = atoi(next());
+    } else if (arg == "--update-interval") {
+      opts.update_interval = atoi(next());
+    } else if (arg == "--window-size") {
+      opts.window_size = atoi(next());
+    } else if (arg == "--weighting") {
+      opts.weightings = next();
+    } else if (arg == "--switch-interval") {
+      opts.switch_interval = atoi(next());
+    } else if (arg == "--time-weighting") {
+      opts.time_weightings = next();
+    } else if (arg == "--threshold") {
+      opts.threshold = atof(next());
+    } else if (arg == "--threshold-duration") {
+      opts.threshold_duration = atoi(next());
+    } else if (arg == "--snapshot") {
+      opts.snapshot = atoi(next());
+    } else if (arg == "--snapshot-post") {
+      opts.snapshot_post_trigger = atoi(next());
+    } else if (arg == "--snapshot-file") {
+      opts.snapshot_file = next();
+    } else if (arg == "--tap-port") {
+      opts.tap_port = atoi(next());
+    } else if (arg == "--tap-buffers") {
+      opts.tap_buffers = atoi(next());
+    } else if (arg == "--tap-wait") {
+      opts.tap_wait = true;
+    } else if (arg == "--history") {
+      opts.history = atoi(next());
+    } else if (arg == "--exposure") {
+      opts.exposure_start = atoll(next());
+    } else if (arg == "--generic-sos") {
+      opts.generic_sos = true;
+    } else if (arg == "--fixed-point") {
+      opts.fixed_point = true;
+    } else if (arg == "--workers") {
+      opts.workers = atoi(next());
+    } else if (arg == "--mic-sensitivity") {
+      opts.mic_sensitivity = atof(next());
+    } else if (arg == "--mic-sensitivity-ref") {
+      opts.mic_sensitivity_ref = atof(next());
+    } else if (arg == "--offset") {
+      opts.offset = atof(next());
+    } else if (arg == "--raw-format") {
+      if (!parse_raw_format(next(), opts.raw_format))
+        return false;
+    } else if (arg == "--raw-sample-rate") {
+      opts.raw_format.sample_rate = atoi(next());
+    } else if (arg == "--raw-channels") {
+      opts.raw_format.channels = atoi(next());
+    } else if (arg == "--channel") {
+      opts.raw_format.channel = atoi(next());
+    } else if (arg == "--bits-shift") {
+      opts.raw_format.bits_shift = atoi(next());
+    } else if (arg == "--gap-interval") {
+      opts.gap_interval = atoi(next());
+    } else if (arg == "--gap-length") {
+      opts.gap_length = atoi(next());
+    } else if (arg == "--expect-dropped-samples") {
+      opts.expect_dropped_samples = atoi(next());
+    } else if (arg == "--profile") {
+      opts.profile = true;
+    } else if (arg == "--verbose") {
+      host_log_level() = HOST_LOG_DEBUG;
+    } else if (arg == "-h" || arg == "--help") {
+      return false;
+    } else if (arg.rfind("--", 0) == 0) {
+      fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+      return false;
+    } else {
+      opts.files.push_back(arg);
+    }
+  }
+  return !opts.files.empty() && opts.buffer_size > 0;
+}
+
+static double processed_seconds = 0;
+
+static void add_sensor(SoundLevelMeter *meter, SensorGroup *group, SoundLevelMeterSensor *sensor,
+                       const std::string &name, const Options &opts) {
+  sensor->set_name(name);
+  sensor->set_parent(meter);
+  sensor->set_update_interval(opts.update_interval);
+  sensor->add_on_state_callback(
+      [sensor](float state) { printf("%.3f,%s,%.2f\n", processed_seconds, sensor->get_name().c_str(), state); });
+  group->add_sensor(sensor);
+  if (opts.history > 0)
+    meter->add_history_sensor(sensor);
+}
+
+static bool write_snapshot(SnapshotBuffer *snapshot, const std::string &path) {
+  FILE *f = fopen(path.c_str(), "wb");
+  if (f == nullptr)
+    return false;
+  // read in chunks, like it would be sent from the device
+  uint8_t chunk[4096];
+  size_t offset = 0, n;
+  while ((n = snapshot->read_wav(offset, chunk, sizeof(chunk))) > 0) {
+    fwrite(chunk, 1, n, f);
+    offset += n;
+  }
+  return fclose(f) == 0 && offset == snapshot->get_wav_size();
+}
+
+int main(int argc, char **argv) {
+  Options opts;
+  if (!parse_args(argc, argv, opts)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  WavSampleSource source(opts.files, opts.raw_format);
+  if (!source.open_next())
+    return 1;
+  uint32_t sample_rate = source.get_sample_rate();
+  auto ms_to_samples = [sample_rate](uint32_t ms) { return uint32_t(uint64_t(ms) * sample_rate / 1000); };
+  GapSampleSource gap_source(&source, ms_to_samples(opts.gap_interval), ms_to_samples(opts.gap_length));
+  SampleSource *input = &source;
+  if (opts.gap_interval > 0 && opts.gap_length > 0)
+    input = &gap_source;
+
+  auto *meter = new SoundLevelMeter();
+  meter->set_source(input);
+  meter->set_update_interval(opts.update_interval);
+  meter->set_buffer_size(opts.buffer_size);
+  meter->set_mic_sensitivity(opts.mic_sensitivity);
+  meter->set_mic_sensitivity_ref(opts.mic_sensitivity_ref);
+  meter->set_offset(opts.offset);
+  meter->set_fixed_point(opts.fixed_point);
+  meter->set_worker_count(opts.workers);
+  meter->set_snapshot_duration(opts.snapshot);
+  meter->set_snapshot_post_trigger(opts.snapshot_post_trigger);
+  meter->set_history_size(opts.history);
+  meter->add_on_history_export_callback([](std::vector<HistoryRecord> records) {
+    for (auto &r : records)
+      printf("history,%s,%.2f\n", r.sensor->get_name().c_str(), r.value);
+  });
+  if (!opts.snapshot_file.empty()) {
+    meter->add_on_snapshot_callback([meter, &opts]() {
+      if (!write_snapshot(meter->get_snapshot(), opts.snapshot_file))
+        ESP_LOGE(TAG, "Failed to write snapshot to %s", opts.snapshot_file.c_str());
+      else
+        ESP_LOGI(TAG, "Snapshot taken at %.3fs written to %s", processed_seconds, opts.snapshot_file.c_str());
+    });
+  }
+
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  PcmTap *tap = nullptr;
+#else
+  if (opts.tap_port > 0) {
+    fprintf(stderr, "Tap requires build with -DSOUND_LEVEL_METER_TAP=ON\n");
+    return 2;
+  }
+#endif
+  // wall clock of exposure sensors follows processed audio
+  time::RealTimeClock clock;
+  std::vector<Component *> exposure_sensors;
+  // 'S' weighting, sets are switched every switch_interval of audio
+  SwitchableSOS_Filter *switchable = nullptr;
+  static const char *const SWITCH_SETS[] = {"A", "C", "Z"};
+  // repeated weightings get the same filter object, like identical filters of sibling groups from codegen
+  std::map<char, Filter *> weighting_filters;
+  for (char w : opts.weightings) {
+    auto *group = new SensorGroup();
+    group->set_parent(meter);
+#ifdef USE_SOUND_LEVEL_METER_TAP
+    if (opts.tap_port > 0 && tap == nullptr) {
+      tap = new PcmTap();
+      tap->set_port(opts.tap_port);
+      tap->set_buffer_count(opts.tap_buffers);
+      group->set_tap(tap);
+    }
+#endif
+    if (w != 'A' && w != 'C' && w != 'Z' && w != 'S') {
+      fprintf(stderr, "Unknown weighting: %c\n", w);
+      return 2;
+    }
+    // coefficients are designed for the sample rate of the input, like `type: weighting` does
+    if (w != 'Z' && weighting_coeffs(sample_rate, 'A').empty()) {
+      fprintf(stderr, "No weighting filters for sample rate of %uHz\n", sample_rate);
+      return 2;
+    }
+    if (w == 'S') {
+      switchable = new SwitchableSOS_Filter();
+      switchable->add_set("A", weighting_coeffs(sample_rate, 'A'));
+      switchable->add_set("C", weighting_coeffs(sample_rate, 'C'));
+      switchable->add_set("Z", {});
+      group->add_filter(switchable);
+    } else if (w != 'Z') {
+      auto &filter = weighting_filters[w];
+      if (filter == nullptr)
+        filter = make_weighting_filter(sample_rate, w, opts.generic_sos);
+      group->add_filter(filter);
+    }
+    std::string suffix(1, w);
+    add_sensor(meter, group, new SoundLevelMeterSensorEq(), "L" + suffix + "eq", opts);
+    auto *max = new SoundLevelMeterSensorMax();
+    add_sensor(meter, group, max, "L" + suffix + "max", opts);
+    max->set_window_size(opts.window_size);
+    auto *min = new SoundLevelMeterSensorMin();
+    add_sensor(meter, group, min, "L" + suffix + "min", opts);
+    min->set_window_size(opts.window_size);
+    auto *peak = new SoundLevelMeterSensorPeak();
+    add_sensor(meter, group, peak, "L" + suffix + "peak", opts);
+    if (opts.threshold.has_value()) {
+      peak->set_threshold(*opts.threshold);
+      peak->set_threshold_duration(opts.threshold_duration);
+      // regular output stays the same, crossings are printed separately
+      peak->set_publish_on_threshold(false);
+      peak->add_on_threshold_callback([meter, peak](float level) {
+        printf("%.3f,%s threshold,%.2f\n", processed_seconds, peak->get_name().c_str(), level);
+        meter->take_snapshot();
+      });
+    }
+    if (opts.exposure_start.has_value()) {
+      for (auto metric : {EXPOSURE_LEX_8H, EXPOSURE_LDEN, EXPOSURE_DOSE}) {
+        auto *exposure = new SoundLevelMeterSensorExposure();
+        exposure->set_time(&clock);
+        exposure->set_metric(metric);
+        if (metric == EXPOSURE_LDEN)
+          exposure->set_day_start_hour(7);
+        const char *name = metric == EXPOSURE_LEX_8H ? "EX8h" : metric == EXPOSURE_LDEN ? "den" : "dose";
+        add_sensor(meter, group, exposure, "L" + suffix + name, opts);
+        exposure_sensors.push_back(exposure);
+      }
+    }
+    for (char t : opts.time_weightings) {
+      TimeWeighting time_weighting;
+      switch (t) {
+        case 'F':
+          time_weighting = TIME_WEIGHTING_FAST;
+          break;
+        case 'S':
+          time_weighting = TIME_WEIGHTING_SLOW;
+          break;
+        case 'I':
+          time_weighting = TIME_WEIGHTING_IMPULSE;
+          break;
+        default:
+          fprintf(stderr, "Unknown time weighting: %c\n", t);
+          return 2;
+      }
+      for (auto statistic : {TIME_WEIGHTED_MAX, TIME_WEIGHTED_MIN}) {
+        auto *tw = new SoundLevelMeterSensorTimeWeighted();
+        tw->set_time_weighting(time_weighting);
+        tw->set_statistic(statistic);
+        add_sensor(meter, group, tw, "L" + suffix + t + (statistic == TIME_WEIGHTED_MAX ? "max" : "min"), opts);
+      }
+    }
+    meter->add_group(group);
+  }
+
+  meter->setup();
+  if (meter->is_failed())
+    return 1;
+  for (auto *c : exposure_sensors)
+    c->setup();
+  meter->dump_config();
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  if (tap != nullptr && opts.tap_wait) {
+    ESP_LOGI(TAG, "Waiting for tap client on port %u", opts.tap_port);
+    while (!tap->is_connected())
+      vTaskDelay(pdMS_TO_TICKS(10));
+  }
+#endif
+
+  std::vector<float> buffer(opts.buffer_size);
+  std::vector<int32_t> buffer_fixed(opts.buffer_size);
+  size_t samples_read;
+  uint64_t samples = 0;
+  auto start = esp_timer_get_time();
+  while (opts.fixed_point ? input->read_samples(buffer_fixed.data(), buffer_fixed.size(), &samples_read)
+                          : input->read_samples(buffer.data(), buffer.size(), &samples_read)) {
+    samples += samples_read;
+    processed_seconds = double(samples) / sample_rate;
+    // the reader task does the same on device
+    if (auto *snapshot = meter->get_snapshot()) {
+      if (opts.fixed_point)
+        snapshot->write(buffer_fixed.data(), samples_read);
+      else
+        snapshot->write(buffer.data(), samples_read);
+    }
+    if (opts.fixed_point)
+      meter->process(buffer_fixed.data(), samples_read);
+    else
+      meter->process(buffer.data(), samples_read);
+    meter->loop();
+    if (switchable != nullptr && opts.switch_interval > 0) {
+      uint64_t interval_samples = uint64_t(opts.switch_interval) * sample_rate / 1000;
+      uint64_t previous = (samples - samples_read) / interval_samples, current = samples / interval_samples;
+      if (current != previous)
+        switchable->select(SWITCH_SETS[current % 3]);
+    }
+    if (opts.exposure_start.has_value()) {
+      clock.set_epoch_time(*opts.exposure_start + time_t(processed_seconds));
+      for (auto *c : exposure_sensors)
+        c->loop();
+    }
+  }
+  double elapsed = (esp_timer_get_time() - start) / 1e6;
+
+  ESP_LOGI(TAG, "Processed %llu samples (%.1fs of audio) in %.3fs: %.0f samples/s, %.1fx real time",
+           (unsigned long long) samples, processed_seconds, elapsed, samples / elapsed, processed_seconds / elapsed);
+  ESP_LOGI(TAG, "Publish queue high water mark: %u, dropped: %u", meter->get_publish_queue_high_water_mark(),
+           meter->get_dropped_publishes());
+  if (meter->get_dropped_samples() > 0)
+    ESP_LOGI(TAG, "Dropped samples: %u", meter->get_dropped_samples());
+#ifdef USE_SOUND_LEVEL_METER_TAP
+  if (tap != nullptr) {
+    // replay is usually faster than the client, the rest of the queue is sent before exit
+    while (tap->is_connected() && tap->get_pending_blocks() > 0)
+      vTaskDelay(pdMS_TO_TICKS(10));
+    ESP_LOGI(TAG, "Tap blocks sent: %u, dropped: %u", tap->get_sent_blocks(), tap->get_dropped_blocks());
+  }
+#endif
+  if (auto *history = meter->get_history()) {
+    // like export after connection is restored, ages are not printed as replay runs faster than real time
+    meter->export_history();
+    while (history->is_exporting())
+      meter->loop();
+    ESP_LOGI(TAG, "History: %u records, %.2f bytes per record, %u lost", history->get_record_count(),
+             double(history->get_encoded_size()) / std::max<uint32_t>(history->get_record_count(), 1),
+             history->get_lost_records());
+  }
+  if (opts.profile)
+    meter->dump_profile();
+  if (source.has_error())
+    return 1;
+  if (opts.expect_dropped_samples.has_value() && meter->get_dropped_samples() != *opts.expect_dropped_samples) {
+    ESP_LOGE(TAG, "Expected %u dropped samples, reported %u", *opts.expect_dropped_samples,
+             meter->get_dropped_samples());
+    return 3;
+  }
+  return 0;
+}
@@ -0,0 +1,216 @@
+#include "wav_source.h"
+#include <cstring>
+#include <type_traits>
+
+namespace esphome {
+namespace sound_level_meter {
+
+static const char *const TAG = "wav_source";
+
+static const uint16_t WAVE_FORMAT_PCM = 1;
+static const uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+static const uint16_t WAVE_FORMAT_EXTENSIBLE = 0xfffe;
+
+static uint16_t read_le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t read_le32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+
+bool parse_raw_format(const char *name, RawFormat &format) {
+  if (strcmp(name, "s16") == 0) {
+    format.format = SAMPLE_FORMAT_S16;
+  } else if (strcmp(name, "s24") == 0) {
+    format.format = SAMPLE_FORMAT_S24;
+  } else if (strcmp(name, "s32") == 0) {
+    format.format = SAMPLE_FORMAT_S32;
+  } else if (strcmp(name, "f32") == 0) {
+    format.format = SAMPLE_FORMAT_F32;
+  } else {
+    ESP_LOGE(TAG, "Unknown raw format: %s", name);
+    return false;
+  }
+  return true;
+}
+
+WavSampleSource::WavSampleSource(std::vector<std::string> files, RawFormat raw_format)
+    : files_(std::move(files)), raw_format_(raw_format) {}
+
+WavSampleSource::~WavSampleSource() {
+  if (this->file_ != nullptr)
+    fclose(this->file_);
+}
+
+uint32_t WavSampleSource::get_sample_rate() { return this->sample_rate_; }
+bool WavSampleSource::has_error() const { return this->error_; }
+
+size_t WavSampleSource::bytes_per_sample() const {
+  switch (this->format_.format) {
+    case SAMPLE_FORMAT_S16:
+      return 2;
+    case SAMPLE_FORMAT_S24:
+      return 3;
+    default:
+      return 4;
+  }
+}
+
+bool WavSampleSource::open_next() {
+  if (this->file_ != nullptr) {
+    fclose(this->file_);
+    this->file_ = nullptr;
+  }
+  if (this->next_file_ >= this->files_.size())
+    return false;
+
+  auto &name = this->files_[this->next_file_++];
+  this->file_ = fopen(name.c_str(), "rb");
+  if (this->file_ == nullptr) {
+    ESP_LOGE(TAG, "Can't open %s: %s", name.c_str(), strerror(errno));
+    this->error_ = true;
+    return false;
+  }
+
+  uint8_t magic[4];
+  bool is_wav = fread(magic, 1, 4, this->file_) == 4 && memcmp(magic, "RIFF", 4) == 0;
+  if (is_wav) {
+    if (!this->read_wav_header()) {
+      ESP_LOGE(TAG, "%s: unsupported or malformed WAV file", name.c_str());
+      this->error_ = true;
+      return false;
+    }
+  } else {
+    rewind(this->file_);
+    this->format_ = this->raw_format_;
+    this->data_left_ = UINT64_MAX;
+  }
+
+  if (this->format_.channel >= this->format_.channels) {
+    ESP_LOGE(TAG, "%s: channel %u requested, but file has only %u", name.c_str(), this->format_.channel,
+             this->format_.channels);
+    this->error_ = true;
+    return false;
+  }
+  if (this->sample_rate_ == 0) {
+    this->sample_rate_ = this->format_.sample_rate;
+  } else if (this->sample_rate_ != this->format_.sample_rate) {
+    ESP_LOGE(TAG, "%s: sample rate %u differs from %u of previous files", name.c_str(), this->format_.sample_rate,
+             this->sample_rate_);
+    this->error_ = true;
+    return false;
+  }
+
+  this->frame_buffer_.resize(this->bytes_per_sample() * this->format_.channels);
+  ESP_LOGD(TAG, "Opened %s: %u Hz, %u channel(s), %u bytes per sample", name.c_str(), this->format_.sample_rate,
+           this->format_.channels, this->bytes_per_sample());
+  return true;
+}
+
+bool WavSampleSource::read_wav_header() {
+  uint8_t header[8];
+  if (fread(header, 1, 8, this->file_) != 8 || memcmp(header + 4, "WAVE", 4) != 0)
+    return false;
+
+  bool has_fmt = false;
+  while (fread(header, 1, 8, this->file_) == 8) {
+    uint32_t size = read_le32(header + 4);
+    if (memcmp(header, "fmt ", 4) == 0) {
+      std::vector<uint8_t> fmt(size);
+      if (size < 16 || fread(fmt.data(), 1, size, this->file_) != size)
+        return false;
+      uint16_t tag = read_le16(&fmt[0]);
+      if (tag == WAVE_FORMAT_EXTENSIBLE && size >= 26)
+        tag = read_le16(&fmt[24]);
+      uint16_t bits = read_le16(&fmt[14]);
+      this->format_.channels = read_le16(&fmt[2]);
+      this->format_.sample_rate = read_le32(&fmt[4]);
+      this->format_.channel = this->raw_format_.channel;
+      this->format_.bits_shift = this->raw_format_.bits_shift;
+      if (tag == WAVE_FORMAT_PCM && bits == 16) {
+        this->format_.format = SAMPLE_FORMAT_S16;
+      } else if (tag == WAVE_FORMAT_PCM && bits == 24) {
+        this->format_.format = SAMPLE_FORMAT_S24;
+      } else if (tag == WAVE_FORMAT_PCM && bits == 32) {
+        this->format_.format = SAMPLE_FORMAT_S32;
+      } else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) {
+        this->format_.format = SAMPLE_FORMAT_F32;
+      } else {
+        return false;
+      }
+      has_fmt = true;
+    } else if (memcmp(header, "data", 4) == 0) {
+      this->data_left_ = size;
+      return has_fmt;
+    } else {
+      fseek(this->file_, size + (size & 1), SEEK_CUR);
+    }
+  }
+  return false;
+}
+
+// returns sample value after bits shift and number of its significant bits (without sign)
+int32_t WavSampleSource::read_int(const uint8_t *sample, uint8_t *sample_bits) const {
+  switch (this->format_.format) {
+    case SAMPLE_FORMAT_S16:
+      *sample_bits = 15 - this->format_.bits_shift;
+      return int16_t(read_le16(sample)) >> this->format_.bits_shift;
+    case SAMPLE_FORMAT_S24:
+      *sample_bits = 23 - this->format_.bits_shift;
+      // place 24 bit value into upper bytes to get sign extension for free
+      return (int32_t((sample[0] << 8) | (sample[1] << 16) | (uint32_t(sample[2]) << 24)) >> 8) >>
+             this->format_.bits_shift;
+    default:
+      *sample_bits = 31 - this->format_.bits_shift;
+      return int32_t(read_le32(sample)) >> this->format_.bits_shift;
+  }
+}
+
+float WavSampleSource::convert(const uint8_t *sample) const {
+  if (this->format_.format == SAMPLE_FORMAT_F32) {
+    float f;
+    uint32_t bits = read_le32(sample);
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  uint8_t sample_bits;
+  int32_t value = this->read_int(sample, &sample_bits);
+  return value / float((1UL << sample_bits) - 1);
+}
+
+int32_t WavSampleSource::convert_fixed(const uint8_t *sample) const {
+  if (this->format_.format == SAMPLE_FORMAT_F32)
+    return to_fixed_point(this->convert(sample), FIXED_POINT_FRAC_BITS);
+  uint8_t sample_bits;
+  int32_t value = this->read_int(sample, &sample_bits);
+  int shift = FIXED_POINT_FRAC_BITS - sample_bits;
+  return shift >= 0 ? int32_t(uint32_t(value) << shift) : value >> -shift;
+}
+
+bool WavSampleSource::read_samples(float *data, size_t num_samples, size_t *samples_read) {
+  return this->read_samples_(data, num_samples, samples_read);
+}
+
+bool WavSampleSource::read_samples(int32_t *data, size_t num_samples, size_t *samples_read) {
+  return this->read_samples_(data, num_samples, samples_read);
+}
+
+template<typename T> bool WavSampleSource::read_samples_(T *data, size_t num_samples, size_t *samples_read) {
+  size_t n = 0;
+  size_t sample_size = this->bytes_per_sample();
+  while (n < num_samples && this->file_ != nullptr) {
+    if (this->data_left_ >= this->frame_buffer_.size() &&
+        fread(this->frame_buffer_.data(), this->frame_buffer_.size(), 1, this->file_) == 1) {
+      this->data_left_ -= this->frame_buffer_.size();
+      const uint8_t *sample = &this->frame_buffer_[this->format_.channel * sample_size];
+      if (std::is_same<T, float>::value) {
+        data[n++] = this->convert(sample);
+      } else {
+        data[n++] = this->convert_fixed(sample);
+      }
+    } else if (!this->open_next()) {
+      break;
+    }
+  }
+  *samples_read = n;
+  return n > 0;
+}
+
+}  // namespace sound_level_meter
+}  // namespace esphome
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "sound_level_meter/sound_level_meter.h"
+
+namespace esphome {
+namespace sound_level_meter {
+
+enum SampleFormat { SAMPLE_FORMAT_S16, SAMPLE_FORMAT_S24, SAMPLE_FORMAT_S32, SAMPLE_FORMAT_F32 };
+
+// Layout of headerless PCM files, WAV files carry their own format in the header
+struct RawFormat {
+  SampleFormat format{SAMPLE_FORMAT_S32};
+  uint32_t sample_rate{48000};
+  uint16_t channels{1};
+  uint16_t channel{0};
+  uint8_t bits_shift{0};
+};
+
+bool parse_raw_format(const char *name, RawFormat &format);
+
+// Streams a list of WAV/raw PCM files as a single continuous recording.
+// Integer samples are converted the same way as I2SComponent/I2SSampleSource do it.
+class WavSampleSource : public SampleSource {
+ public:
+  WavSampleSource(std::vector<std::string> files, RawFormat raw_format);
+  ~WavSampleSource();
+  virtual uint32_t get_sample_rate() override;
+  virtual bool read_samples(float *data, size_t num_samples, size_t *samples_read) override;
+  virtual bool read_samples(int32_t *data, size_t num_samples, size_t *samples_read) override;
+  bool open_next();
+  bool has_error() const;
+
+ protected:
+  std::vector<std::string> files_;
+  size_t next_file_{0};
+  FILE *file_{nullptr};
+  RawFormat raw_format_;
+  RawFormat format_;
+  uint32_t sample_rate_{0};
+  uint64_t data_left_{0};
+  std::vector<uint8_t> frame_buffer_;
+  bool error_{false};
+
+  bool read_wav_header();
+  size_t bytes_per_sample() const;
+  int32_t read_int(const uint8_t *sample, uint8_t *sample_bits) const;
+  float convert(const uint8_t *sample) const;
+  int32_t convert_fixed(const uint8_t *sample) const;
+  template<typename T> bool read_samples_(T *data, size_t num_samples, size_t *samples_read);
+};
+
+}  // namespace sound_level_meter
+}  // namespace esphome